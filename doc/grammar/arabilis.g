@@ -98,9 +98,9 @@ STRING
         ;
 
 COMMENT
-        : '#' ~( '\n'|'\r' )* '\r'? '\n' { $channel=HIDDEN; }
+        : '#' ~( '\n' )* { $channel=HIDDEN; }
         ;
 
 WHITESPACE
-        : ( ' ' | '\t' | '\r' | '\n' ) { $channel=HIDDEN; }
+        : ( ' ' | '\t' | '\r' | '\n' )+ { $channel=HIDDEN; }
         ;
@@ -110,7 +110,143 @@ test_arabilis() {
 }
 
 
+test_arabilis_optimized() {
+    ( "${comp_arabilis2label}" -O1 | "${comp_macro2label}" | "${comp_label2hex}" | "${comp_hex2bin}" ) \
+        < "${src}/fizzbuzz.arabilis" \
+        > "fizzbuzz_optimized"
+    chmod +x fizzbuzz_optimized
+
+    if output="$(./fizzbuzz_optimized)"
+    then
+        retcode="0"
+    else
+        retcode="${?}"
+    fi
+
+    compare \
+        arabilis_optimized \
+        "${retcode}" \
+        "${output}" \
+        0 \
+        "1 2 Fizz 4 Buzz Fizz 7 8 Fizz Buzz 11 Fizz 13 14 `
+            `FizzBuzz 16 17 Fizz 19 "
+}
+
+
+test_arabilis_inlined() {
+    "${comp_arabilis2label}" -O2 --emit=elf < "${src}/fizzbuzz.arabilis" \
+        > "fizzbuzz_inlined"
+    chmod +x fizzbuzz_inlined
+
+    if output="$(./fizzbuzz_inlined)"
+    then
+        retcode="0"
+    else
+        retcode="${?}"
+    fi
+
+    compare \
+        arabilis_inlined \
+        "${retcode}" \
+        "${output}" \
+        0 \
+        "1 2 Fizz 4 Buzz Fizz 7 8 Fizz Buzz 11 Fizz 13 14 `
+            `FizzBuzz 16 17 Fizz 19 "
+}
+
+
+test_arabilis_elf() {
+    for file in "${src}"/*.arabilis
+    do
+        local name="$(basename "${file}" .arabilis)"
+        for level in -O0 -O1 -O2
+        do
+            ( "${comp_arabilis2label}" "${level}" | "${comp_macro2label}" | "${comp_label2hex}" | "${comp_hex2bin}" ) \
+                < "${file}" \
+                > "${name}_macro${level}"
+            "${comp_arabilis2label}" "${level}" --emit=elf < "${file}" \
+                > "${name}_elf${level}"
+
+            if ! cmp -s "${name}_macro${level}" "${name}_elf${level}"
+            then
+                echo "arabilis_elf: ${name} ${level} output differs from the macro pipeline"
+                exit 1
+            fi
+        done
+    done
+}
+
+
+# Compile "${src}/<name>.arabilis" with the remaining arguments as options
+# and check the exit code of the program.
+test_arabilis_program() {
+    local name="${1}"
+    local expect_code="${2}"
+    shift 2
+
+    ( "${comp_arabilis2label}" "${@}" | "${comp_macro2label}" | "${comp_label2hex}" | "${comp_hex2bin}" ) \
+        < "${src}/${name}.arabilis" \
+        > "${name}"
+    chmod +x "${name}"
+
+    if output="$(./"${name}")"
+    then
+        retcode="0"
+    else
+        retcode="${?}"
+    fi
+
+    compare "${name} ${*}" "${retcode}" "${output}" "${expect_code}" ""
+}
+
+
+# Compile "${src}/<name>.arabilis" with the remaining arguments as options
+# and check the number of direct calls in the code. Inlined calls are gone.
+test_arabilis_direct_calls() {
+    local name="${1}"
+    local expect_calls="${2}"
+    shift 2
+
+    calls="$("${comp_arabilis2label}" "${@}" < "${src}/${name}.arabilis" \
+        | grep -c "^call_rel32 " || true)"
+
+    if [ "${expect_calls}" != "${calls}" ]
+    then
+        echo "${name} ${*}: ${calls} direct calls instead of ${expect_calls}"
+        exit 1
+    fi
+}
+
+
 test_hex
 test_label
 test_macro
 test_arabilis
+test_arabilis_optimized
+test_arabilis_elf
+test_arabilis_inlined
+test_arabilis_program loop_var 216
+test_arabilis_program loop_var 216 -O1
+test_arabilis_program fold_division 0
+test_arabilis_program fold_division 0 -O1
+test_arabilis_program registers 0
+test_arabilis_program registers 0 -O1
+test_arabilis_program long_loop 0
+test_arabilis_program long_loop 0 -O1
+test_arabilis_program comparisons 0
+test_arabilis_program comparisons 0 -O1
+test_arabilis_program direct_calls 0
+test_arabilis_program direct_calls 0 -O1
+test_arabilis_program inline 0
+test_arabilis_program inline 0 -O1
+test_arabilis_program inline 0 -O2
+test_arabilis_direct_calls inline 6 -O1
+test_arabilis_direct_calls inline 1 -O2
+test_arabilis_program inline_shadowing 0
+test_arabilis_program inline_shadowing 0 -O1
+test_arabilis_program inline_shadowing 0 -O2
+test_arabilis_direct_calls inline_shadowing 3 -O2
+test_arabilis_program inline_arguments 0
+test_arabilis_program inline_arguments 0 -O1
+test_arabilis_program inline_arguments 0 -O2
+test_arabilis_direct_calls inline_arguments 2 -O2
@@ -2,14 +2,21 @@
 // Copyright 2020 Tim Wiederhake
 
 #include "backend.h"
+#include "branches.h"
+#include "elf.h"
 #include "frontend.h"
 #include "io.h"
+#include "optimizer.h"
+#include "peephole.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
 #include <string>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 enum class mode {
     only_io,
     only_lex,
@@ -17,13 +24,44 @@ enum class mode {
     default_mode
 };
 
+enum class emit {
+    macro,
+    elf
+};
+
 static void usage(std::ostream& stream) {
     stream
         << "Usage: arabilis [options] file\n"
         << "Options:\n"
         << "--help                  Display this information.\n"
         << "-o, --out-file <file>   Place the output into <file>. " \
-            "Defaults to stdout.\n";
+            "Defaults to stdout.\n"
+        << "-j, --jobs <n>          Check functions in <n> threads. " \
+            "Defaults to 1.\n"
+        << "--error-limit <n>       Stop after <n> errors, 0 for no limit. " \
+            "Defaults to 0.\n"
+        << "--emit=macro, --emit=elf\n"
+        << "                        Output macro code or an executable. " \
+            "Defaults to macro.\n"
+        << "-O0, -O1, -O2           Optimization level. Defaults to -O0.\n"
+        << "--peephole-stats        Print the number of peephole rewrites " \
+            "to stderr.\n";
+}
+
+/* Parse a decimal number up to `max`, without sign or leading zeros. */
+static bool parse_number(const char* text, unsigned max, unsigned& value) {
+    if (text[0] < '0' || text[0] > '9' || (text[0] == '0' && text[1] != 0)) {
+        return false;
+    }
+
+    char* end = nullptr;
+    const unsigned long number = std::strtoul(text, &end, 10);
+    if (*end != '\0' || number > max) {
+        return false;
+    }
+
+    value = static_cast<unsigned>(number);
+    return true;
 }
 
 static char visual_char(int c) {
@@ -59,11 +97,13 @@ static int mode_only_io(arabilis::Reader& reader, arabilis::Writer& writer) {
     return 0;
 }
 
-static int mode_only_lex(arabilis::Lexer& lexer, arabilis::Writer& writer) {
-    const std::string& filename = lexer.filename();
+static int mode_only_lex(
+        const arabilis::TokenArray& tokens,
+        arabilis::Writer& writer) {
+    const std::string& filename = tokens.filename();
 
-    for (;;) {
-        const arabilis::Token token = lexer.read();
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        const arabilis::Token token = tokens.kind(i);
         if (token == arabilis::Token::eof) {
             break;
         }
@@ -73,14 +113,16 @@ static int mode_only_lex(arabilis::Lexer& lexer, arabilis::Writer& writer) {
         case arabilis::Token::identifier:
         case arabilis::Token::numeral:
         case arabilis::Token::literal:
-            name += " (\"" + lexer.data() + + "\")";
+            name += " (\"";
+            name += tokens.data(i);
+            name += "\")";
             break;
         default:
             break;
         }
 
         std::transform(name.begin(), name.end(), name.begin(), visual_char);
-        writer << filename << ':' << lexer.position() << ": " << name << '\n';
+        writer << filename << ':' << tokens.position(i) << ": " << name << '\n';
     }
 
     return 0;
@@ -97,6 +139,16 @@ int main(int argc, char* argv[]) {
 
     mode mode { mode::default_mode };
 
+    unsigned jobs { 1 };
+
+    unsigned error_limit { 0 };
+
+    unsigned optimize { 0 };
+
+    bool peephole_stats { false };
+
+    emit emit { emit::macro };
+
     for (int i = 1; i < argc; ++i) {
         const std::string arg { argv[i] };
 
@@ -133,6 +185,48 @@ int main(int argc, char* argv[]) {
                 continue;
             }
 
+            if (arg == "-j" || arg == "--jobs" || arg == "--error-limit") {
+                if (i == argc - 1) {
+                    std::cerr
+                        << "Error: Missing parameter to "
+                        << arg
+                        << "\n\n";
+                    usage(std::cerr);
+                    std::exit(1);
+                }
+
+                i += 1;
+                const bool valid = (arg == "--error-limit")
+                    ? parse_number(argv[i], 1000000, error_limit)
+                    : parse_number(argv[i], 1024, jobs) && jobs > 0;
+                if (!valid) {
+                    std::cerr
+                        << "Error: Invalid parameter to "
+                        << arg
+                        << " \""
+                        << argv[i]
+                        << "\"\n";
+                    std::exit(1);
+                }
+
+                continue;
+            }
+
+            if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+                optimize = arg[2] - '0';
+                continue;
+            }
+
+            if (arg == "--emit=macro" || arg == "--emit=elf") {
+                emit = (arg == "--emit=elf") ? emit::elf : emit::macro;
+                continue;
+            }
+
+            if (arg == "--peephole-stats") {
+                peephole_stats = true;
+                continue;
+            }
+
             if (arg == "--only-io") {
                 if (mode != mode::default_mode) {
                     std::cerr << "Error: Invalid mode combination\n";
@@ -178,37 +272,40 @@ int main(int argc, char* argv[]) {
         infilename_set = true;
     }
 
-    std::ifstream instream;
     arabilis::Reader reader = [&]() {
         if (infilename_set) {
-            instream.open(infilename, std::ios::binary);
-            if (!instream) {
+            const int fd = open(infilename.c_str(), O_RDONLY);
+            if (fd < 0) {
                 std::cerr
                     << "Error: Unable to open input file \""
                     << infilename
                     << "\"\n";
                 exit(1);
             }
-            return arabilis::Reader { infilename, instream };
+            arabilis::Reader reader { infilename, fd };
+            close(fd);
+            return reader;
         } else {
-            return arabilis::Reader { "interactive", std::cin };
+            return arabilis::Reader { "interactive", STDIN_FILENO };
         }
     }();
 
-    std::ofstream outstream;
     arabilis::Writer writer = [&]() {
         if (outfilename_set) {
-            outstream.open(outfilename, std::ios::binary);
-            if (!outstream) {
+            const int fd = open(
+                outfilename.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC,
+                (emit == emit::elf) ? 0777 : 0666);
+            if (fd < 0) {
                 std::cerr
                     << "Error: Unable to open output file \""
                     << outfilename
                     << "\"\n";
                 exit(1);
             }
-            return arabilis::Writer { outstream };
+            return arabilis::Writer { fd };
         } else {
-            return arabilis::Writer { std::cout };
+            return arabilis::Writer { STDOUT_FILENO };
         }
     }();
 
@@ -216,20 +313,72 @@ int main(int argc, char* argv[]) {
         return mode_only_io(reader, writer);
     }
 
-    arabilis::Lexer lexer { reader };
+    arabilis::Diagnostics diagnostics { reader.filename(), error_limit };
+
+    arabilis::Lexer lexer { reader, diagnostics };
+    const arabilis::TokenArray tokens = lexer.read_all();
+    diagnostics.exit_on_errors();
 
     if (mode == mode::only_lex) {
-        return mode_only_lex(lexer, writer);
+        return mode_only_lex(tokens, writer);
     }
 
-    arabilis::Parser parser { lexer };
-    arabilis::Program program = parser.read();
-    arabilis::check_variable_usage(program);
+    arabilis::Parser parser { tokens, diagnostics };
+    const arabilis::Program program = parser.read();
+    diagnostics.exit_on_errors();
+
+    const arabilis::FlatAst ast = arabilis::flatten(program);
 
     if (mode == mode::only_parse) {
+        arabilis::check_variable_usage(ast, diagnostics, jobs);
+        diagnostics.exit_on_errors();
+        return 0;
+    }
+
+    const auto write = [&](const arabilis::Code& code) {
+        if (emit == emit::elf) {
+            arabilis::write_elf(code, writer);
+        } else {
+            arabilis::print(code, writer);
+        }
+    };
+
+    /* folding and inlining drop names, so the program is checked before */
+    if (optimize > 0) {
+        arabilis::check_variable_usage(ast, diagnostics, jobs);
+        diagnostics.exit_on_errors();
+        arabilis::CompileOptions options {};
+        options.m_registers = true;
+        options.m_relative_branches = true;
+        options.m_direct_calls = true;
+        arabilis::Code code = arabilis::compile_program(
+            (optimize > 1)
+                ? arabilis::fold_constants(arabilis::inline_functions(ast))
+                : arabilis::fold_constants(ast),
+            options);
+
+        const auto counts = arabilis::optimize_peephole(code);
+        arabilis::relax_branches(code);
+        if (peephole_stats) {
+            for (const auto& [name, count] : counts) {
+                std::cerr << "peephole: " << name << ": " << count << '\n';
+            }
+        }
+        write(code);
+        return 0;
+    }
+
+    /* a single thread is fastest when checking while compiling */
+    if (jobs == 1) {
+        const arabilis::Code code =
+            arabilis::check_and_compile_program(ast, diagnostics);
+        diagnostics.exit_on_errors();
+        write(code);
         return 0;
     }
 
-    arabilis::compile_program(program, writer);
+    arabilis::check_variable_usage(ast, diagnostics, jobs);
+    diagnostics.exit_on_errors();
+    write(arabilis::compile_program(ast));
     return 0;
 }
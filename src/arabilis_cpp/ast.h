@@ -5,14 +5,18 @@
 #define AST_H_
 
 #include "io.h"
+#include "symbols.h"
 
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace arabilis {
 
-enum class Token {
+enum class Token : std::uint8_t {
     string_break,
     string_continue,
     string_else,
@@ -62,10 +66,105 @@ enum class Token {
     eof
 };
 
-const char* token_to_name(Token token);
+constexpr const char* token_to_name(Token t) {
+    switch (t) {
+    case Token::string_break:
+        return "break";
+    case Token::string_continue:
+        return "continue";
+    case Token::string_else:
+        return "else";
+    case Token::string_false:
+        return "false";
+    case Token::string_for:
+        return "for";
+    case Token::string_function:
+        return "function";
+    case Token::string_if:
+        return "if";
+    case Token::string_let:
+        return "let";
+    case Token::string_return:
+        return "return";
+    case Token::string_true:
+        return "true";
+    case Token::string_var:
+        return "var";
+    case Token::string_while:
+        return "while";
+    case Token::bracket_round_left:
+        return "(";
+    case Token::bracket_round_right:
+        return ")";
+    case Token::bracket_curly_left:
+        return "{";
+    case Token::bracket_curly_right:
+        return "}";
+    case Token::token_plus:
+        return "+";
+    case Token::token_minus:
+        return "-";
+    case Token::token_multiply:
+        return "*";
+    case Token::token_divide:
+        return "/";
+    case Token::token_modulo:
+        return "%";
+    case Token::token_log_not:
+        return "!";
+    case Token::token_log_and:
+        return "&&";
+    case Token::token_log_or:
+        return "||";
+    case Token::token_bit_not:
+        return "~";
+    case Token::token_bit_and:
+        return "&";
+    case Token::token_bit_or:
+        return "|";
+    case Token::token_bit_xor:
+        return "^";
+    case Token::token_equal:
+        return "==";
+    case Token::token_notequal:
+        return "!=";
+    case Token::token_less:
+        return "<";
+    case Token::token_lessequal:
+        return "<=";
+    case Token::token_greater:
+        return ">";
+    case Token::token_greaterequal:
+        return ">=";
+    case Token::token_comma:
+        return ",";
+    case Token::token_semicolon:
+        return ";";
+    case Token::token_assign:
+        return "=";
+    case Token::identifier:
+        return "IDENTIFIER";
+    case Token::numeral:
+        return "NUMERAL";
+    case Token::literal:
+        return "STRING";
+    case Token::eof:
+        return "END OF FILE";
+    default:
+        break;
+    }
+
+    throw "invalid token";
+}
 
 class Visitor;
 
+/*
+ * Names in the tree are symbols of the `SymbolTable` built by the `Lexer`.
+ * String values refer to the input buffer of the `Reader` and to literals
+ * decoded by the `Lexer`. Both must outlive the `Program`.
+ */
+
 struct AST {
     explicit AST(const Position& position) noexcept : m_position { position } {
     }
@@ -127,12 +226,17 @@ struct GlobalVar: public AST {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_name;
-    std::unique_ptr<Expression> m_value;
+    Symbol m_name;
+    Expression* m_value { nullptr };
 };
 
 struct Function: public AST {
-    explicit Function(const Position& position) noexcept : AST { position } {
+    explicit Function(
+            const Position& position,
+            std::pmr::memory_resource* arena) noexcept :
+                    AST { position },
+                    m_arguments { arena },
+                    m_statements { arena } {
     }
 
     Function(const Function&) noexcept = delete;
@@ -145,30 +249,48 @@ struct Function: public AST {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_name;
-    std::vector<std::string> m_arguments;
-    std::vector<std::unique_ptr<Statement>> m_statements;
+    Symbol m_name;
+    std::pmr::vector<Symbol> m_arguments;
+    std::pmr::vector<Statement*> m_statements;
 };
 
+/*
+ * All nodes of a program, and the vectors they own, live in its arena. They
+ * are never destroyed one by one, releasing the arena frees the whole tree.
+ */
 struct Program: public AST {
-    explicit Program(std::string filename) noexcept :
-            AST { Position {} },
-            m_filename { std::move(filename) } {
+    explicit Program(
+            std::string_view filename,
+            const SymbolTable& symbols) noexcept :
+                    AST { Position {} },
+                    m_symbols { &symbols },
+                    m_arena {
+                        std::make_unique<std::pmr::monotonic_buffer_resource>()
+                    },
+                    m_filename { filename, m_arena.get() },
+                    m_globalvars { m_arena.get() },
+                    m_functions { m_arena.get() } {
     }
 
     Program(const Program&) noexcept = delete;
     Program& operator=(const Program&) noexcept = delete;
 
     Program(Program&&) noexcept = default;
-    Program& operator=(Program&&) noexcept = default;
+    Program& operator=(Program&&) noexcept = delete;
 
     ~Program() noexcept override = default;
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_filename;
-    std::vector<GlobalVar> m_globalvars;
-    std::vector<Function> m_functions;
+    [[nodiscard]] std::pmr::memory_resource* arena() const noexcept {
+        return m_arena.get();
+    }
+
+    const SymbolTable* m_symbols;
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> m_arena;
+    std::pmr::string m_filename;
+    std::pmr::vector<GlobalVar> m_globalvars;
+    std::pmr::vector<Function> m_functions;
 };
 
 struct BreakStatement: public Statement {
@@ -219,12 +341,15 @@ struct ExpressionStatement: public Statement {
 
     void visit(Visitor&) const noexcept override;
 
-    std::unique_ptr<Expression> m_expression;
+    Expression* m_expression { nullptr };
 };
 
 struct ForStatement: public Statement {
-    explicit ForStatement(const Position& position) noexcept :
-            Statement { position } {
+    explicit ForStatement(
+            const Position& position,
+            std::pmr::memory_resource* arena) noexcept :
+                    Statement { position },
+                    m_statements { arena } {
     }
 
     ForStatement(const ForStatement&) noexcept = delete;
@@ -237,16 +362,20 @@ struct ForStatement: public Statement {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_variable_name;
-    std::unique_ptr<Expression> m_initial;
-    std::unique_ptr<Expression> m_condition;
-    std::unique_ptr<Expression> m_update;
-    std::vector<std::unique_ptr<Statement>> m_statements;
+    Symbol m_variable_name;
+    Expression* m_initial { nullptr };
+    Expression* m_condition { nullptr };
+    Expression* m_update { nullptr };
+    std::pmr::vector<Statement*> m_statements;
 };
 
 struct IfStatement: public Statement {
-    explicit IfStatement(const Position& position) noexcept :
-            Statement { position } {
+    explicit IfStatement(
+            const Position& position,
+            std::pmr::memory_resource* arena) noexcept :
+                    Statement { position },
+                    m_then_statements { arena },
+                    m_else_statements { arena } {
     }
 
     IfStatement(const IfStatement&) noexcept = delete;
@@ -259,9 +388,9 @@ struct IfStatement: public Statement {
 
     void visit(Visitor&) const noexcept override;
 
-    std::unique_ptr<Expression> m_condition;
-    std::vector<std::unique_ptr<Statement>> m_then_statements;
-    std::vector<std::unique_ptr<Statement>> m_else_statements;
+    Expression* m_condition { nullptr };
+    std::pmr::vector<Statement*> m_then_statements;
+    std::pmr::vector<Statement*> m_else_statements;
 };
 
 struct LetStatement: public Statement {
@@ -279,8 +408,8 @@ struct LetStatement: public Statement {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_variable_name;
-    std::unique_ptr<Expression> m_expression;
+    Symbol m_variable_name;
+    Expression* m_expression { nullptr };
 };
 
 struct ReturnStatement: public Statement {
@@ -298,7 +427,7 @@ struct ReturnStatement: public Statement {
 
     void visit(Visitor&) const noexcept override;
 
-    std::unique_ptr<Expression> m_expression;
+    Expression* m_expression { nullptr };
 };
 
 struct VarStatement: public Statement {
@@ -316,13 +445,16 @@ struct VarStatement: public Statement {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_variable_name;
-    std::unique_ptr<Expression> m_expression;
+    Symbol m_variable_name;
+    Expression* m_expression { nullptr };
 };
 
 struct WhileStatement: public Statement {
-    explicit WhileStatement(const Position& position) noexcept :
-            Statement { position } {
+    explicit WhileStatement(
+            const Position& position,
+            std::pmr::memory_resource* arena) noexcept :
+                    Statement { position },
+                    m_statements { arena } {
     }
 
     WhileStatement(const WhileStatement&) noexcept = delete;
@@ -335,16 +467,16 @@ struct WhileStatement: public Statement {
 
     void visit(Visitor&) const noexcept override;
 
-    std::unique_ptr<Expression> m_condition;
-    std::vector<std::unique_ptr<Statement>> m_statements;
+    Expression* m_condition { nullptr };
+    std::pmr::vector<Statement*> m_statements;
 };
 
 struct AddressOfExpression: public Expression {
     explicit AddressOfExpression(
             const Position& position,
-            std::string variable_name) noexcept :
+            Symbol variable_name) noexcept :
                     Expression { position },
-                    m_variable_name { std::move(variable_name) } {
+                    m_variable_name { variable_name } {
     }
 
     AddressOfExpression(const AddressOfExpression&) noexcept = delete;
@@ -358,19 +490,19 @@ struct AddressOfExpression: public Expression {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_variable_name;
+    Symbol m_variable_name;
 };
 
 struct BinOpExpression: public Expression {
     explicit BinOpExpression(
             const Position& position,
             Token token,
-            std::unique_ptr<Expression> lhs,
-            std::unique_ptr<Expression> rhs) noexcept :
+            Expression* lhs,
+            Expression* rhs) noexcept :
                     Expression { position },
                     m_token { token },
-                    m_lhs { std::move(lhs) },
-                    m_rhs { std::move(rhs) } {
+                    m_lhs { lhs },
+                    m_rhs { rhs } {
     }
 
     BinOpExpression(const BinOpExpression&) noexcept = delete;
@@ -384,17 +516,18 @@ struct BinOpExpression: public Expression {
     void visit(Visitor&) const noexcept override;
 
     Token m_token;
-    std::unique_ptr<Expression> m_lhs;
-    std::unique_ptr<Expression> m_rhs;
+    Expression* m_lhs { nullptr };
+    Expression* m_rhs { nullptr };
 };
 
 struct CallExpression: public Expression {
     explicit CallExpression(
             const Position& position,
-            std::string variable_name) noexcept :
+            Symbol variable_name,
+            std::pmr::memory_resource* arena) noexcept :
                     Expression { position },
-                    m_variable_name { std::move(variable_name) },
-                    m_arguments {} {
+                    m_variable_name { variable_name },
+                    m_arguments { arena } {
     }
 
     CallExpression(const CallExpression&) noexcept = delete;
@@ -407,8 +540,8 @@ struct CallExpression: public Expression {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_variable_name;
-    std::vector<std::unique_ptr<Expression>> m_arguments;
+    Symbol m_variable_name;
+    std::pmr::vector<Expression*> m_arguments;
 };
 
 struct NumeralExpression: public Expression {
@@ -433,7 +566,7 @@ struct NumeralExpression: public Expression {
 struct StringExpression: public Expression {
     explicit StringExpression(
             const Position& position,
-            std::string value) noexcept :
+            std::string_view value) noexcept :
                     Expression { position },
                     m_value { value } {
     }
@@ -448,17 +581,17 @@ struct StringExpression: public Expression {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_value;
+    std::string_view m_value;
 };
 
 struct UnOpExpression: public Expression {
     explicit UnOpExpression(
             const Position& position,
             Token token,
-            std::unique_ptr<Expression> rhs) noexcept :
+            Expression* rhs) noexcept :
                     Expression { position },
                     m_token { token },
-                    m_rhs { std::move(rhs) } {
+                    m_rhs { rhs } {
     }
 
     UnOpExpression(const UnOpExpression&) noexcept = delete;
@@ -472,13 +605,13 @@ struct UnOpExpression: public Expression {
     void visit(Visitor&) const noexcept override;
 
     Token m_token;
-    std::unique_ptr<Expression> m_rhs;
+    Expression* m_rhs { nullptr };
 };
 
 struct VariableExpression: public Expression {
     explicit VariableExpression(
             const Position& position,
-            std::string variable_name) noexcept :
+            Symbol variable_name) noexcept :
                     Expression { position },
                     m_variable_name { variable_name } {
     }
@@ -493,7 +626,7 @@ struct VariableExpression: public Expression {
 
     void visit(Visitor&) const noexcept override;
 
-    std::string m_variable_name;
+    Symbol m_variable_name;
 };
 
 } /* namespace arabilis */
@@ -3,323 +3,479 @@
 
 #include "backend.h"
 
+#include "elf.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
-#include <map>
-#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace arabilis {
 
 Visitor::~Visitor() noexcept {
 }
 
-class VariableUsage: public Visitor {
+static void duplicate_symbol(
+        Diagnostics& diagnostics,
+        const FlatAst& ast,
+        NodeIndex node,
+        Symbol name) noexcept {
+
+    std::string message { "duplicate symbol name \"" };
+    message += ast.name(name);
+    message += '"';
+    diagnostics.error(ast.position(node), message);
+}
+
+static void unknown_symbol(
+        Diagnostics& diagnostics,
+        const FlatAst& ast,
+        NodeIndex node,
+        Symbol name) noexcept {
+
+    std::string message { "unknown symbol name \"" };
+    message += ast.name(name);
+    message += '"';
+    diagnostics.error(ast.position(node), message);
+}
+
+/* `node` is a "break" or "continue" statement. */
+static void outside_loop(
+        Diagnostics& diagnostics,
+        const FlatAst& ast,
+        NodeIndex node) noexcept {
+
+    const bool is_break = ast.kind(node) == NodeKind::break_statement;
+
+    diagnostics.error(
+        ast.position(node),
+        is_break
+            ? "\"break\" outside of FOR or WHILE loop"
+            : "\"continue\" outside of FOR or WHILE loop");
+}
+
+static void check_main(Diagnostics& diagnostics, const FlatAst& ast) noexcept {
+    const Symbol main = ast.symbols().find("main");
+    for (const NodeIndex function : ast.functions()) {
+        if (ast.symbol(function, 0) == main) {
+            return;
+        }
+    }
+
+    diagnostics.error("missing \"main\" function");
+}
+
+/*
+ * Error found by `VariableUsage`. Errors are recorded rather than reported,
+ * as functions may be checked concurrently and out of order.
+ */
+struct UsageError {
+    enum class Kind : std::uint8_t {
+        duplicate_symbol,
+        unknown_symbol,
+        outside_loop
+    };
+
+    Kind m_kind;
+    NodeIndex m_node;
+    Symbol m_name;
+};
+
+static void report(
+        Diagnostics& diagnostics,
+        const FlatAst& ast,
+        const UsageError& error) noexcept {
+
+    switch (error.m_kind) {
+    case UsageError::Kind::duplicate_symbol:
+        duplicate_symbol(diagnostics, ast, error.m_node, error.m_name);
+        break;
+    case UsageError::Kind::unknown_symbol:
+        unknown_symbol(diagnostics, ast, error.m_node, error.m_name);
+        break;
+    case UsageError::Kind::outside_loop:
+        outside_loop(diagnostics, ast, error.m_node);
+        break;
+    }
+}
+
+/*
+ * Global variables and functions are visible from the point of their
+ * declaration on, global variables before all functions. The rank of a
+ * symbol is the point of its first global declaration: 0 for global
+ * variables, 1 + index for functions.
+ */
+using Rank = std::uint32_t;
+
+static constexpr Rank not_declared = UINT32_MAX;
+
+/* Checks the body of one function at a time, see `check_function`. */
+class VariableUsage {
 public:
-    explicit VariableUsage(std::string filename) noexcept:
-            m_filename { std::move(filename) } {
+    explicit VariableUsage(
+            const FlatAst& ast,
+            const std::vector<Rank>& ranks) noexcept :
+                    m_ast { ast },
+                    m_ranks { ranks },
+                    m_local_symbols(ast.symbols().size()) {
     }
 
     VariableUsage(const VariableUsage&) noexcept = delete;
     VariableUsage& operator=(const VariableUsage&) noexcept = delete;
 
     VariableUsage(VariableUsage&&) noexcept = default;
-    VariableUsage& operator=(VariableUsage&&) noexcept = default;
-
-    ~VariableUsage() noexcept override = default;
-
-    void operator()(const AddressOfExpression*) override;
-    void operator()(const BinOpExpression*) override;
-    void operator()(const BreakStatement*) override;
-    void operator()(const CallExpression*) override;
-    void operator()(const ContinueStatement*) override;
-    void operator()(const ExpressionStatement*) override;
-    void operator()(const ForStatement*) override;
-    void operator()(const Function*) override;
-    void operator()(const GlobalVar*) override;
-    void operator()(const IfStatement*) override;
-    void operator()(const LetStatement*) override;
-    void operator()(const NumeralExpression*) override;
-    void operator()(const Program*) override;
-    void operator()(const ReturnStatement*) override;
-    void operator()(const StringExpression*) override;
-    void operator()(const UnOpExpression*) override;
-    void operator()(const VariableExpression*) override;
-    void operator()(const VarStatement*) override;
-    void operator()(const WhileStatement*) override;
+    VariableUsage& operator=(VariableUsage&&) noexcept = delete;
+
+    ~VariableUsage() noexcept = default;
+
+    /* Check the `index`-th function, return the errors in source order. */
+    std::vector<UsageError> check_function(std::size_t index) noexcept;
 
 private:
-    std::string m_filename;
+    const FlatAst& m_ast;
     bool m_inside_loop = false;
-    std::set<std::string> m_global_symbols = {};
-    std::set<std::string> m_local_symbols = {};
 
-    /** Create a nested scope. */
-    VariableUsage with_block_scope(bool inside_loop) noexcept;
+    /* rank of each symbol, see `Rank` */
+    const std::vector<Rank>& m_ranks;
+
+    /* rank of the function being checked */
+    Rank m_rank { 0 };
+
+    /* whether a symbol is declared locally, indexed by symbol */
+    ScopedSymbols<bool> m_local_symbols;
+
+    std::vector<UsageError> m_errors {};
+
+    /* State of the enclosing block, saved when entering a nested one. */
+    struct Block {
+        std::size_t m_scope;
+        bool m_inside_loop;
+    };
+
+    /** Dispatch on the kind of a node. */
+    void visit(NodeIndex);
+
+    void visit_address_of(NodeIndex);
+    void visit_bin_op(NodeIndex);
+    void visit_break(NodeIndex);
+    void visit_call(NodeIndex);
+    void visit_continue(NodeIndex);
+    void visit_expression_statement(NodeIndex);
+    void visit_for(NodeIndex);
+    void visit_if(NodeIndex);
+    void visit_let(NodeIndex);
+    void visit_return(NodeIndex);
+    void visit_un_op(NodeIndex);
+    void visit_variable(NodeIndex);
+    void visit_var(NodeIndex);
+    void visit_while(NodeIndex);
 
-    /** Check that a global variable is unique. */
-    void unique_global(const Position&, const std::string&) noexcept;
+    /** Enter a nested block scope. */
+    Block enter_block(bool inside_loop) noexcept;
+
+    /** Leave a nested block scope, restoring the enclosing one. */
+    void leave_block(const Block&) noexcept;
+
+    /** Whether a symbol is visible as global from the current function. */
+    bool is_global(Symbol) const noexcept;
+
+    /** Record an error. */
+    void fail(UsageError::Kind, NodeIndex, Symbol = 0) noexcept;
 
     /** Check that a local variable is unique in the current context. */
-    void unique_local(const Position&, const std::string&) noexcept;
+    void unique_local(NodeIndex, Symbol) noexcept;
 
     /** Check that a name refers to either a local or global variable. */
-    void check_variable(const Position&, const std::string&) noexcept;
+    void check_variable(NodeIndex, Symbol) noexcept;
 };
 
-void check_variable_usage(Program& program) noexcept {
-    VariableUsage variable_usage { program.m_filename };
-    program.visit(variable_usage);
-}
+void check_variable_usage(
+        const FlatAst& ast,
+        Diagnostics& diagnostics,
+        unsigned jobs) noexcept {
 
-void VariableUsage::operator()(const AddressOfExpression* node) {
-    check_variable(node->m_position, node->m_variable_name);
-}
+    const std::vector<NodeIndex>& functions = ast.functions();
 
-void VariableUsage::operator()(const BinOpExpression* node) {
-    node->m_lhs->visit(*this);
-    node->m_rhs->visit(*this);
-}
+    /* register globals, serially and in order */
+    std::vector<Rank> ranks(ast.symbols().size(), not_declared);
 
-void VariableUsage::operator()(const BreakStatement* node) {
-    if (m_inside_loop) {
-        return;
+    for (const NodeIndex globalvar : ast.globalvars()) {
+        const Symbol name = ast.symbol(globalvar, 0);
+        if (ranks[name] != not_declared) {
+            duplicate_symbol(diagnostics, ast, globalvar, name);
+            continue;
+        }
+        ranks[name] = 0;
     }
 
-    std::cerr
-        << m_filename
-        << ':'
-        << node->m_position
-        << ": Error: \"break\" outside of FOR or WHILE loop\n";
-    std::exit(1);
-}
+    std::vector<bool> duplicates(functions.size());
+    for (std::size_t i = 0; i < functions.size(); ++i) {
+        const Symbol name = ast.symbol(functions[i], 0);
+        if (ranks[name] != not_declared) {
+            duplicates[i] = true;
+            continue;
+        }
+        ranks[name] = static_cast<Rank>(i + 1);
+    }
+
+    /* check function bodies, in parallel and in any order */
+    std::vector<std::vector<UsageError>> errors(functions.size());
+    std::atomic<std::size_t> next { 0 };
+
+    const auto worker = [&]() {
+        VariableUsage variable_usage { ast, ranks };
+        for (;;) {
+            const std::size_t i = next++;
+            if (i >= functions.size()) {
+                return;
+            }
+
+            errors[i] = variable_usage.check_function(i);
+        }
+    };
 
-void VariableUsage::operator()(const CallExpression* node) {
-    check_variable(node->m_position, node->m_variable_name);
-    for (auto& argument : node->m_arguments) {
-        argument->visit(*this);
+    const std::size_t threads = std::min<std::size_t>(jobs, functions.size());
+    std::vector<std::thread> pool {};
+    for (std::size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
     }
-}
 
-void VariableUsage::operator()(const ContinueStatement* node) {
-    if (m_inside_loop) {
-        return;
+    /* report in source order, as a serial check would */
+    for (std::size_t i = 0; i < functions.size(); ++i) {
+        if (duplicates[i]) {
+            const Symbol name = ast.symbol(functions[i], 0);
+            duplicate_symbol(diagnostics, ast, functions[i], name);
+        }
+
+        for (const UsageError& error : errors[i]) {
+            report(diagnostics, ast, error);
+        }
     }
-    std::cerr
-        << m_filename
-        << ':'
-        << node->m_position
-        << ": Error: \"continue\" outside of FOR or WHILE loop\n";
-    std::exit(1);
-}
 
-void VariableUsage::operator()(const ExpressionStatement* node) {
-    node->m_expression->visit(*this);
+    check_main(diagnostics, ast);
 }
 
-void VariableUsage::operator()(const ForStatement* node) {
-    node->m_initial->visit(*this);
+std::vector<UsageError> VariableUsage::check_function(
+        std::size_t index) noexcept {
+
+    const NodeIndex node = m_ast.functions()[index];
 
-    VariableUsage inner = with_block_scope(true);
-    inner.unique_local(node->m_position, node->m_variable_name);
+    m_rank = static_cast<Rank>(index + 1);
+    m_errors.clear();
 
-    node->m_condition->visit(inner);
-    node->m_update->visit(inner);
+    const Block outer = enter_block(false);
 
-    for (auto& statement : node->m_statements) {
-        statement->visit(inner);
+    for (const Symbol argument : m_ast.list(node, 1)) {
+        unique_local(node, argument);
+    }
+
+    for (const NodeIndex statement : m_ast.list(node, 2)) {
+        visit(statement);
     }
-}
 
-void VariableUsage::operator()(const Function* node) {
-    unique_global(node->m_position, node->m_name);
+    leave_block(outer);
 
-    m_local_symbols.clear();
+    return std::move(m_errors);
+}
 
-    for (auto& argument : node->m_arguments) {
-        unique_local(node->m_position, argument);
+void VariableUsage::visit(NodeIndex node) {
+    switch (m_ast.kind(node)) {
+    case NodeKind::global_var:
+    case NodeKind::function:
+        break;
+    case NodeKind::break_statement:
+        visit_break(node);
+        break;
+    case NodeKind::continue_statement:
+        visit_continue(node);
+        break;
+    case NodeKind::expression_statement:
+        visit_expression_statement(node);
+        break;
+    case NodeKind::for_statement:
+        visit_for(node);
+        break;
+    case NodeKind::if_statement:
+        visit_if(node);
+        break;
+    case NodeKind::let_statement:
+        visit_let(node);
+        break;
+    case NodeKind::return_statement:
+        visit_return(node);
+        break;
+    case NodeKind::var_statement:
+        visit_var(node);
+        break;
+    case NodeKind::while_statement:
+        visit_while(node);
+        break;
+    case NodeKind::address_of:
+        visit_address_of(node);
+        break;
+    case NodeKind::bin_op:
+        visit_bin_op(node);
+        break;
+    case NodeKind::call:
+        visit_call(node);
+        break;
+    case NodeKind::numeral:
+    case NodeKind::string:
+        break;
+    case NodeKind::un_op:
+        visit_un_op(node);
+        break;
+    case NodeKind::variable:
+        visit_variable(node);
+        break;
     }
+}
 
-    for (auto& statement : node->m_statements) {
-        statement->visit(*this);
-    }
+VariableUsage::Block VariableUsage::enter_block(bool inside_loop) noexcept {
+    const Block outer { m_local_symbols.enter(), m_inside_loop };
+    m_inside_loop = inside_loop;
+    return outer;
 }
 
-void VariableUsage::operator()(const GlobalVar* node) {
-    unique_global(node->m_position, node->m_name);
+void VariableUsage::leave_block(const Block& outer) noexcept {
+    m_local_symbols.leave(outer.m_scope);
+    m_inside_loop = outer.m_inside_loop;
 }
 
-void VariableUsage::operator()(const IfStatement* node) {
-    node->m_condition->visit(*this);
+void VariableUsage::visit_address_of(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
+}
 
-    VariableUsage inner_then = with_block_scope(m_inside_loop);
-    for (auto& statement : node->m_then_statements) {
-        statement->visit(inner_then);
+void VariableUsage::visit_bin_op(NodeIndex node) {
+    visit(m_ast.child(node, 0));
+    visit(m_ast.child(node, 1));
+}
+
+void VariableUsage::visit_break(NodeIndex node) {
+    if (!m_inside_loop) {
+        fail(UsageError::Kind::outside_loop, node);
     }
+}
 
-    VariableUsage inner_else = with_block_scope(m_inside_loop);
-    for (auto& statement : node->m_else_statements) {
-        statement->visit(inner_else);
+void VariableUsage::visit_call(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
+    for (const NodeIndex argument : m_ast.list(node, 1)) {
+        visit(argument);
     }
 }
 
-void VariableUsage::operator()(const LetStatement* node) {
-    check_variable(node->m_position, node->m_variable_name);
-    node->m_expression->visit(*this);
+void VariableUsage::visit_continue(NodeIndex node) {
+    if (!m_inside_loop) {
+        fail(UsageError::Kind::outside_loop, node);
+    }
 }
 
-void VariableUsage::operator()(const NumeralExpression* /* node */) {
+void VariableUsage::visit_expression_statement(NodeIndex node) {
+    visit(m_ast.child(node, 0));
 }
 
-void VariableUsage::operator()(const Program* node) {
-    for (auto& globalvar : node->m_globalvars) {
-        globalvar.visit(*this);
-    }
+void VariableUsage::visit_for(NodeIndex node) {
+    const FlatList clauses = m_ast.list(node, 1);
 
-    for (auto& function : node->m_functions) {
-        function.visit(*this);
-    }
+    visit(clauses[0]);
 
-    const bool has_main = [node]() {
-        for (auto& f : node->m_functions) {
-            if (f.m_name == "main") {
-                return true;
-            }
-        }
-        return false;
-    }();
+    const Block outer = enter_block(true);
+    unique_local(node, m_ast.symbol(node, 0));
 
-    if (has_main) {
-        return;
+    visit(clauses[1]);
+    visit(clauses[2]);
+
+    for (const NodeIndex statement : m_ast.list(node, 2)) {
+        visit(statement);
     }
 
-    std::cerr << m_filename << ": Error: missing \"main\" function\n";
-    std::exit(1);
+    leave_block(outer);
 }
 
-void VariableUsage::operator()(const ReturnStatement* node) {
-    node->m_expression->visit(*this);
-}
+void VariableUsage::visit_if(NodeIndex node) {
+    visit(m_ast.child(node, 0));
 
-void VariableUsage::operator()(const StringExpression* /* node */) {
-}
+    const Block outer_then = enter_block(m_inside_loop);
+    for (const NodeIndex statement : m_ast.list(node, 1)) {
+        visit(statement);
+    }
+    leave_block(outer_then);
 
-void VariableUsage::operator()(const UnOpExpression* node) {
-    node->m_rhs->visit(*this);
+    const Block outer_else = enter_block(m_inside_loop);
+    for (const NodeIndex statement : m_ast.list(node, 2)) {
+        visit(statement);
+    }
+    leave_block(outer_else);
 }
 
-void VariableUsage::operator()(const VariableExpression* node) {
-    check_variable(node->m_position, node->m_variable_name);
+void VariableUsage::visit_let(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
+    visit(m_ast.child(node, 1));
 }
 
-void VariableUsage::operator()(const VarStatement* node) {
-    node->m_expression->visit(*this);
-    unique_local(node->m_position, node->m_variable_name);
+void VariableUsage::visit_return(NodeIndex node) {
+    visit(m_ast.child(node, 0));
 }
 
-void VariableUsage::operator()(const WhileStatement* node) {
-    node->m_condition->visit(*this);
+void VariableUsage::visit_un_op(NodeIndex node) {
+    visit(m_ast.child(node, 0));
+}
 
-    VariableUsage inner = with_block_scope(true);
-    for (auto& statement : node->m_statements) {
-        statement->visit(inner);
-    }
+void VariableUsage::visit_variable(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
 }
 
-VariableUsage VariableUsage::with_block_scope(bool inside_loop) noexcept {
-    VariableUsage variable_usage { m_filename };
-    variable_usage.m_global_symbols = m_global_symbols;
-    variable_usage.m_local_symbols = m_local_symbols;
-    variable_usage.m_inside_loop = inside_loop;
-    return variable_usage;
+void VariableUsage::visit_var(NodeIndex node) {
+    visit(m_ast.child(node, 1));
+    unique_local(node, m_ast.symbol(node, 0));
 }
 
-void VariableUsage::unique_global(
-        const Position& position,
-        const std::string& name) noexcept {
+void VariableUsage::visit_while(NodeIndex node) {
+    visit(m_ast.child(node, 0));
 
-    if (m_global_symbols.find(name) == m_global_symbols.end()) {
-        m_global_symbols.insert(name);
-        return;
+    const Block outer = enter_block(true);
+    for (const NodeIndex statement : m_ast.list(node, 1)) {
+        visit(statement);
     }
+    leave_block(outer);
+}
 
-    std::cerr
-        << m_filename
-        << ':'
-        << position
-        << ": Error: duplicate symbol name \""
-        << name
-        << "\"\n";
-    std::exit(1);
+bool VariableUsage::is_global(Symbol name) const noexcept {
+    return m_ranks[name] <= m_rank;
 }
 
-void VariableUsage::unique_local(
-        const Position& position,
-        const std::string& name) noexcept {
+void VariableUsage::fail(
+        UsageError::Kind kind,
+        NodeIndex node,
+        Symbol name) noexcept {
 
-    if ((m_global_symbols.find(name) == m_global_symbols.end()) &&
-            (m_local_symbols.find(name) == m_local_symbols.end())) {
+    m_errors.push_back({ kind, node, name });
+}
 
-        m_local_symbols.insert(name);
+void VariableUsage::unique_local(NodeIndex node, Symbol name) noexcept {
+    if (is_global(name) || m_local_symbols[name]) {
+        fail(UsageError::Kind::duplicate_symbol, node, name);
         return;
     }
 
-    std::cerr
-        << m_filename
-        << ':'
-        << position
-        << ": Error: duplicate symbol name \""
-        << name
-        << "\"\n";
-    std::exit(1);
+    m_local_symbols.set(name, true);
 }
 
-void VariableUsage::check_variable(
-        const Position& position,
-        const std::string& name) noexcept {
-
-    if ((m_global_symbols.find(name) != m_global_symbols.end()) ||
-            (m_local_symbols.find(name) != m_local_symbols.end())) {
-
-        return;
+void VariableUsage::check_variable(NodeIndex node, Symbol name) noexcept {
+    if (!is_global(name) && !m_local_symbols[name]) {
+        fail(UsageError::Kind::unknown_symbol, node, name);
     }
-
-    std::cerr
-        << m_filename
-        << ':'
-        << position
-        << ": Error: unknown symbol name \""
-        << name
-        << "\"\n";
-    std::exit(1);
 }
 
 static const char hex_compiler_header[] =
-        "                            # Elf32_Ehdr: 0x08048000\n"
-        "7F 45 4C 46 01 01 01 00     #     e_ident[0:7]\n"
-        "00 00 00 00 00 00 00 00     #     e_ident[8:15]\n"
-        "02 00                       #     e_type\n"
-        "03 00                       #     e_machine\n"
-        "01 00 00 00                 #     e_version\n"
-        "54 80 04 08                 #     e_entry\n"
-        "34 00 00 00                 #     e_phoff\n"
-        "00 00 00 00                 #     e_shoff\n"
-        "00 00 00 00                 #     e_flags\n"
-        "34 00                       #     e_ehsize\n"
-        "20 00                       #     e_phentsize\n"
-        "01 00                       #     e_phnum\n"
-        "28 00                       #     e_shentsize\n"
-        "00 00                       #     e_shnum\n"
-        "00 00                       #     e_shstrndx\n"
-        "\n"
-        "                            #   Elf32_Phdr: 0x08048034\n"
-        "01 00 00 00                 #       p_type\n"
-        "00 00 00 00                 #       p_offset\n"
-        "00 80 04 08                 #       p_vaddr\n"
-        "00 80 04 08                 #       p_paddr\n"
-        "size                        #       p_filesz\n"
-        "size                        #       p_memsz\n"
-        "07 00 00 00                 #       p_flags\n"
-        "00 00 00 00                 #       p_align\n"
-        "                            #   _start: 0x08048054\n"
         "\n"
         "\n"
         "%add_eax_ebx:       \"01 D8\"     # add eax, ebx\n"
@@ -366,17 +522,98 @@ static const char hex_compiler_header[] =
         "%setne_al:          \"0F 95 C0\"  # setne al\n"
         "%setne_bl:          \"0F 95 C3\"  # setne bl\n"
         "%sub_eax_ebx:       \"29 D8\"     # sub eax, ebx\n"
+        "%sub_esp_imm:       \"81 EC\"     # sub esp, <imm32>\n"
         "%xor_eax_ebx:       \"31 D8\"     # xor eax, ebx\n"
         "# x86 has no \"je LABEL\". Instead do \"jne l1; jmp LABEL; l1:\"\n"
         "%hop_ne:            \"75 07\"     # jne . + 0x07 => hop over mov + jmp\n"
         "\n"
         "\n";
 
-class Compiler: public Visitor {
+/*
+ * Registers an expression may use, in order of preference. Its value ends
+ * up in the first one, the other ones are scratch registers. Registers not
+ * in the list hold values of enclosing expressions.
+ */
+class Registers {
 public:
-    explicit Compiler(Writer& writer, int& next_unique_id) noexcept:
-        m_writer { writer },
-        m_next_unique_id { next_unique_id } {
+    static constexpr std::size_t capacity = 6;
+
+    /* All registers the expression code generator allocates. */
+    static Registers all() noexcept {
+        return { {
+            Register::eax,
+            Register::ecx,
+            Register::edx,
+            Register::ebx,
+            Register::esi,
+            Register::edi
+        }, capacity };
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    [[nodiscard]] Register operator[](std::size_t index) const noexcept {
+        return m_registers[index];
+    }
+
+    [[nodiscard]] bool contains(Register reg) const noexcept {
+        for (std::size_t i = 0; i < m_size; ++i) {
+            if (m_registers[i] == reg) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* The same registers, with the first two swapped. */
+    [[nodiscard]] Registers swapped() const noexcept {
+        Registers registers = *this;
+        std::swap(registers.m_registers[0], registers.m_registers[1]);
+        return registers;
+    }
+
+    /* The same registers, without the one at `index`. */
+    [[nodiscard]] Registers without(std::size_t index) const noexcept {
+        Registers registers = *this;
+        std::copy(
+            m_registers.begin() + index + 1,
+            m_registers.begin() + m_size,
+            registers.m_registers.begin() + index);
+        registers.m_size -= 1;
+        return registers;
+    }
+
+    std::array<Register, capacity> m_registers;
+    std::size_t m_size;
+};
+
+class Compiler {
+public:
+    explicit Compiler(
+            const FlatAst& ast,
+            Code& code,
+            int& next_unique_id,
+            Diagnostics* diagnostics,
+            const CompileOptions& options) noexcept:
+        m_ast { ast },
+        m_code { code },
+        m_next_unique_id { next_unique_id },
+        m_diagnostics { diagnostics },
+        m_options { options },
+        m_globalvars(ast.symbols().size()),
+        m_entries(ast.symbols().size()),
+        m_localvars(ast.symbols().size()),
+        m_frame_offsets(ast.size()) {
+
+        if (m_options.m_registers) {
+            number_registers();
+        }
+
+        if (m_options.m_direct_calls) {
+            find_reassigned();
+        }
     }
 
     Compiler(const Compiler&) noexcept = delete;
@@ -385,601 +622,1383 @@ public:
     Compiler(Compiler&&) noexcept = default;
     Compiler& operator=(Compiler&&) noexcept = default;
 
-    ~Compiler() noexcept override = default;
-
-    void operator()(const AddressOfExpression*) override;
-    void operator()(const BinOpExpression*) override;
-    void operator()(const BreakStatement*) override;
-    void operator()(const CallExpression*) override;
-    void operator()(const ContinueStatement*) override;
-    void operator()(const ExpressionStatement*) override;
-    void operator()(const ForStatement*) override;
-    void operator()(const Function*) override;
-    void operator()(const GlobalVar*) override;
-    void operator()(const IfStatement*) override;
-    void operator()(const LetStatement*) override;
-    void operator()(const NumeralExpression*) override;
-    void operator()(const Program*) override;
-    void operator()(const ReturnStatement*) override;
-    void operator()(const StringExpression*) override;
-    void operator()(const UnOpExpression*) override;
-    void operator()(const VariableExpression*) override;
-    void operator()(const VarStatement*) override;
-    void operator()(const WhileStatement*) override;
-
-    std::string next_unique_label() noexcept {
-        const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
-        int id = ++m_next_unique_id;
-        std::string label = "";
-
-        while (id > 0) {
-            label += digits[id % 36];
-            id /= 36;
-        }
+    ~Compiler() noexcept = default;
+
+    void visit_program();
+
+    Label next_unique_label() noexcept {
+        return static_cast<Label>(++m_next_unique_id);
+    }
+
+    void add_local(Symbol name, int offset) noexcept {
+        m_localvars.set(name, offset);
+    }
 
-        while(label.size() < 3) {
-            label += '0';
+    void address_of(Symbol name, Register target = Register::eax) noexcept {
+        if (m_globalvars[name] != Label::none) {
+            m_code.add(Opcode::mov_reg_imm, target, m_globalvars[name]);
+            return;
         }
 
-        label += 'l';
+        m_code.add(Opcode::mov_reg_reg, target, Register::ebp);
+        m_code.add(Opcode::add_reg_imm, target, imm(m_localvars[name]));
+    }
 
-        return std::string { label.rbegin(), label.rend() };
+    static Immediate imm(std::int64_t value) noexcept {
+        return { static_cast<std::uint32_t>(value) };
     }
 
-    int next_local_offset() noexcept {
-        int offset = 0;
+    void jump(Label target) noexcept {
+        if (m_options.m_relative_branches) {
+            m_code.add(Opcode::jmp_rel8, target);
+            return;
+        }
 
-        for (const auto& i : m_localvars) {
-            offset = std::min(offset, i.second);
+        m_code.add(Opcode::mov_reg_imm, Register::eax, target);
+        m_code.add(Opcode::jmp_reg, Register::eax);
+    }
+
+    /*
+     * Call a function at its entry label if it is never reassigned, else
+     * through its pointer variable.
+     */
+    void call(Symbol name) noexcept {
+        if (m_entries[name] != Label::none) {
+            m_code.add(Opcode::call_rel32, m_entries[name]);
+            return;
         }
 
-        return offset - 4;
+        address_of(name);
+        m_code.add(Opcode::call_ref_reg, Register::eax);
     }
 
-    void address_of(const std::string& name) noexcept {
-        if (m_globalvars.find(name) != m_globalvars.end()) {
-            m_writer << "mov_eax_imm " << m_globalvars.at(name) << '\n';
+    /* Pop a condition and jump if it is zero. */
+    void jump_if_false(Label target) noexcept {
+        m_code.add(Opcode::pop_reg, Register::eax);
+        m_code.add(Opcode::cmp_reg_imm, Register::eax, Immediate { 0, true });
+
+        if (m_options.m_relative_branches) {
+            m_code.add(Opcode::je_rel8, target);
             return;
         }
 
-        m_writer
-            << "mov_eax_ebp\n"
-            << "add_eax_imm " << as_imm(m_localvars.at(name)) << '\n';
+        m_code.add(Opcode::hop_ne);
+        jump(target);
     }
 
-    std::string byte_to_upper_hex(const unsigned char c) {
-        std::string retval = "00";
-        retval[0] = "0123456789ABCDEF"[0x0f & (c >> 4)];
-        retval[1] = "0123456789ABCDEF"[0x0f & (c >> 0)];
-        return retval;
+    void comment_header(const char* kind, Symbol name) noexcept {
+        std::string text = "\n##\n## ";
+        text += kind;
+        text += " \"";
+        text += m_ast.name(name);
+        text += "\"\n##\n\n";
+        m_code.add_text(text);
     }
 
-    std::string as_imm(uint32_t imm) noexcept {
-        return
-                byte_to_upper_hex(0xff & (imm >> 0)) +
-                byte_to_upper_hex(0xff & (imm >> 8)) +
-                byte_to_upper_hex(0xff & (imm >> 16)) +
-                byte_to_upper_hex(0xff & (imm >> 24));
+private:
+    const FlatAst& m_ast;
+    int& m_next_unique_id;
+    Code& m_code;
+
+    /* Where to report errors if checking while compiling, or nullptr. */
+    Diagnostics* m_diagnostics;
+
+    CompileOptions m_options;
+
+    Label m_return_label { Label::none };
+    Label m_break_label { Label::none };
+    Label m_continue_label { Label::none };
+
+    /* symbol -> absolute label, none if not a global variable. */
+    std::vector<Label> m_globalvars;
+
+    /* symbol -> entry label of a function that is called directly, or none. */
+    std::vector<Label> m_entries;
+
+    /* symbol -> whether "let" or "&" refer to it, see `find_reassigned`. */
+    std::vector<bool> m_reassigned;
+
+    /* symbol -> EBP offset, 0 if not a local variable. */
+    ScopedSymbols<int> m_localvars;
+
+    /* var or for node -> EBP offset of its variable, see `layout_frame`. */
+    std::vector<int> m_frame_offsets;
+
+    /* expression -> registers needed to evaluate it without spilling. */
+    std::vector<std::uint8_t> m_need;
+
+    /* expression -> whether it has no calls, which may change variables. */
+    std::vector<bool> m_pure;
+
+    /* State of the enclosing block, saved when entering a nested one. */
+    struct Block {
+        std::size_t m_scope;
+        Label m_return_label;
+        Label m_break_label;
+        Label m_continue_label;
+    };
+
+    /**
+     * Assign EBP offsets below `offset` to the variables declared in
+     * `statements` and nested blocks. Blocks that are not nested in each
+     * other share slots. Returns the lowest offset used.
+     */
+    int layout_frame(const FlatList& statements, int offset) noexcept;
+
+    /** Enter a nested block scope. */
+    Block enter_block() noexcept;
+
+    /** Leave a nested block scope, restoring the enclosing one. */
+    void leave_block(Block&&) noexcept;
+
+    /** If checking, check that a name is not declared yet. */
+    void check_unique(NodeIndex, Symbol) noexcept;
+
+    /** If checking, check that a name refers to a declared variable. */
+    void check_variable(NodeIndex, Symbol) noexcept;
+
+    /** Dispatch on the kind of a node. */
+    void visit(NodeIndex);
+
+    /** Define the macros of the register forms `evaluate` uses. */
+    void write_register_macros() noexcept;
+
+    /** Define the macros of the relative branches `jump` uses. */
+    void write_branch_macros() noexcept;
+
+    /**
+     * Find the symbols whose value may change after initialization. The
+     * functions among them are called through their pointer variable.
+     */
+    void find_reassigned() noexcept;
+
+    /** Compute the Sethi-Ullman numbers of all expressions. */
+    void number_registers() noexcept;
+
+    /** Evaluate an expression into the first of `registers`. */
+    void evaluate(NodeIndex, const Registers&);
+    void evaluate_bin_op(NodeIndex, const Registers&);
+
+    /** Evaluate the operands of a binary operator into the first two. */
+    void evaluate_operands(NodeIndex, const Registers&);
+    void evaluate_call(NodeIndex, const Registers&);
+    void evaluate_division(Token, const Registers&) noexcept;
+
+    /** Set a register to 1 if the condition holds, else to 0. */
+    void set_condition(Opcode set_byte, Register) noexcept;
+
+    /**
+     * Jump to `target` if a condition is false. Comparisons branch on the
+     * flags of their `cmp` directly.
+     */
+    void branch_if_false(NodeIndex condition, Label target);
+
+    /**
+     * Emit the data of a string literal and a jump over it through a
+     * register. Return the label of the data.
+     */
+    Label write_string(NodeIndex, Register) noexcept;
+
+    void visit_address_of(NodeIndex);
+    void visit_bin_op(NodeIndex);
+    void visit_break(NodeIndex);
+    void visit_call(NodeIndex);
+    void visit_continue(NodeIndex);
+    void visit_expression_statement(NodeIndex);
+    void visit_for(NodeIndex);
+    void visit_function(NodeIndex);
+    void visit_global_var(NodeIndex);
+    void visit_if(NodeIndex);
+    void visit_let(NodeIndex);
+    void visit_numeral(NodeIndex);
+    void visit_return(NodeIndex);
+    void visit_string(NodeIndex);
+    void visit_un_op(NodeIndex);
+    void visit_variable(NodeIndex);
+    void visit_var(NodeIndex);
+    void visit_while(NodeIndex);
+};
+
+/* Rough number of code items per node, to allocate the code at once. */
+static constexpr std::size_t items_per_node = 5;
+
+Code compile_program(
+        const FlatAst& ast,
+        const CompileOptions& options) noexcept {
+
+    Code code {};
+    code.reserve(ast.size() * items_per_node);
+    int next_unique_id { 0 };
+    Compiler compiler { ast, code, next_unique_id, nullptr, options };
+    compiler.visit_program();
+    return code;
+}
+
+Code check_and_compile_program(
+        const FlatAst& ast,
+        Diagnostics& diagnostics) noexcept {
+
+    Code code {};
+    code.reserve(ast.size() * items_per_node);
+    int next_unique_id { 0 };
+    Compiler compiler { ast, code, next_unique_id, &diagnostics, {} };
+    compiler.visit_program();
+    return code;
+}
+
+void Compiler::visit(NodeIndex node) {
+    if (m_options.m_registers && is_expression(m_ast.kind(node))) {
+        evaluate(node, Registers::all());
+        m_code.add(Opcode::push_reg, Register::eax);
+        return;
     }
 
-    Compiler with_return_label(std::string return_label) noexcept {
-        Compiler child { m_writer, m_next_unique_id };
-        child.m_globalvars = m_globalvars;
-        child.m_localvars = m_localvars;
-        child.m_return_label = std::move(return_label);
-        child.m_break_label = m_break_label;
-        child.m_continue_label = m_continue_label;
+    switch (m_ast.kind(node)) {
+    case NodeKind::global_var:
+        visit_global_var(node);
+        break;
+    case NodeKind::function:
+        visit_function(node);
+        break;
+    case NodeKind::break_statement:
+        visit_break(node);
+        break;
+    case NodeKind::continue_statement:
+        visit_continue(node);
+        break;
+    case NodeKind::expression_statement:
+        visit_expression_statement(node);
+        break;
+    case NodeKind::for_statement:
+        visit_for(node);
+        break;
+    case NodeKind::if_statement:
+        visit_if(node);
+        break;
+    case NodeKind::let_statement:
+        visit_let(node);
+        break;
+    case NodeKind::return_statement:
+        visit_return(node);
+        break;
+    case NodeKind::var_statement:
+        visit_var(node);
+        break;
+    case NodeKind::while_statement:
+        visit_while(node);
+        break;
+    case NodeKind::address_of:
+        visit_address_of(node);
+        break;
+    case NodeKind::bin_op:
+        visit_bin_op(node);
+        break;
+    case NodeKind::call:
+        visit_call(node);
+        break;
+    case NodeKind::numeral:
+        visit_numeral(node);
+        break;
+    case NodeKind::string:
+        visit_string(node);
+        break;
+    case NodeKind::un_op:
+        visit_un_op(node);
+        break;
+    case NodeKind::variable:
+        visit_variable(node);
+        break;
+    }
+}
 
-        return child;
+int Compiler::layout_frame(const FlatList& statements, int offset) noexcept {
+    int lowest = offset;
+
+    for (const NodeIndex statement : statements) {
+        switch (m_ast.kind(statement)) {
+        case NodeKind::var_statement:
+            offset -= 4;
+            m_frame_offsets[statement] = offset;
+            lowest = std::min(lowest, offset);
+            break;
+        case NodeKind::for_statement:
+            m_frame_offsets[statement] = offset - 4;
+            lowest = std::min(
+                lowest,
+                layout_frame(m_ast.list(statement, 2), offset - 4));
+            break;
+        case NodeKind::if_statement:
+            lowest = std::min(
+                lowest,
+                layout_frame(m_ast.list(statement, 1), offset));
+            lowest = std::min(
+                lowest,
+                layout_frame(m_ast.list(statement, 2), offset));
+            break;
+        case NodeKind::while_statement:
+            lowest = std::min(
+                lowest,
+                layout_frame(m_ast.list(statement, 1), offset));
+            break;
+        default:
+            break;
+        }
     }
 
-    Compiler with_break_continue_label(
-            std::string break_label,
-            std::string continue_label) noexcept {
+    return lowest;
+}
+
+Compiler::Block Compiler::enter_block() noexcept {
+    return {
+        m_localvars.enter(),
+        m_return_label,
+        m_break_label,
+        m_continue_label
+    };
+}
+
+void Compiler::leave_block(Block&& outer) noexcept {
+    m_localvars.leave(outer.m_scope);
+    m_return_label = std::move(outer.m_return_label);
+    m_break_label = std::move(outer.m_break_label);
+    m_continue_label = std::move(outer.m_continue_label);
+}
+
+void Compiler::check_unique(NodeIndex node, Symbol name) noexcept {
+    if (m_diagnostics == nullptr) {
+        return;
+    }
 
-        Compiler child { m_writer, m_next_unique_id };
-        child.m_globalvars = m_globalvars;
-        child.m_localvars = m_localvars;
-        child.m_return_label = m_return_label;
-        child.m_break_label = std::move(break_label);
-        child.m_continue_label = std::move(continue_label);
+    if (m_globalvars[name] != Label::none || m_localvars[name] != 0) {
+        duplicate_symbol(*m_diagnostics, m_ast, node, name);
+    }
+}
 
-        return child;
+void Compiler::check_variable(NodeIndex node, Symbol name) noexcept {
+    if (m_diagnostics == nullptr) {
+        return;
     }
 
-private:
-    int& m_next_unique_id;
-    Writer& m_writer;
+    if (m_globalvars[name] == Label::none && m_localvars[name] == 0) {
+        unknown_symbol(*m_diagnostics, m_ast, node, name);
+    }
+}
 
-    std::string m_return_label {};
-    std::string m_break_label {};
-    std::string m_continue_label {};
+/* Byte as in a macro definition, e.g. "0F". */
+static std::string byte_to_upper_hex(unsigned byte) noexcept {
+    std::string retval = "00";
+    retval[0] = "0123456789ABCDEF"[0x0f & (byte >> 4)];
+    retval[1] = "0123456789ABCDEF"[0x0f & (byte >> 0)];
+    return retval;
+}
 
-    /* variable name -> absolute label. */
-    std::map<std::string, std::string> m_globalvars;
+/*
+ * Append the definition of a macro to `text`, in the same layout as the
+ * header. Macros the header defines already are skipped.
+ */
+static void define_macro(
+        std::string& text,
+        const std::string& macro,
+        std::initializer_list<unsigned> bytes,
+        const std::string& comment) noexcept {
+
+    const std::string_view header { hex_compiler_header };
+    if (header.find("%" + macro + ":") != std::string_view::npos) {
+        return;
+    }
 
-    /* maps variable name -> EBP offset. */
-    std::map<std::string, int> m_localvars;
-};
+    std::string line = "%" + macro + ":";
+    line.resize(std::max<std::size_t>(line.size() + 1, 20), ' ');
+    line += '"';
+    for (const unsigned byte : bytes) {
+        line += byte_to_upper_hex(byte);
+        line += ' ';
+    }
+    line.back() = '"';
+    line.resize(std::max<std::size_t>(line.size() + 1, 32), ' ');
+    line += "# " + comment + '\n';
+    text += line;
+}
 
-void compile_program(Program& program, Writer& writer) noexcept {
-    int next_unique_id { 0 };
-    Compiler compiler { writer, next_unique_id };
-    program.visit(compiler);
+void Compiler::write_register_macros() noexcept {
+    static const std::pair<const char*, unsigned> operations[] = {
+        { "add", 0x01 },
+        { "or", 0x09 },
+        { "and", 0x21 },
+        { "sub", 0x29 },
+        { "xor", 0x31 },
+        { "cmp", 0x39 }
+    };
+
+    static const std::pair<const char*, unsigned> conditions[] = {
+        { "e", 0x94 },
+        { "ne", 0x95 },
+        { "l", 0x9C },
+        { "ge", 0x9D },
+        { "le", 0x9E },
+        { "g", 0x9F }
+    };
+
+    std::string text {};
+
+    const auto define = [&](
+            const std::string& macro,
+            std::initializer_list<unsigned> bytes,
+            const std::string& comment) {
+        define_macro(text, macro, bytes, comment);
+    };
+
+    text += "# Register forms for expressions evaluated in registers\n";
+
+    const Registers registers = Registers::all();
+    for (std::size_t i = 0; i < registers.size(); ++i) {
+        const unsigned r = static_cast<unsigned>(registers[i]);
+        const std::string rn = name(registers[i]);
+
+        define("mov_" + rn + "_imm", { 0xB8 + r }, "mov " + rn + ", <imm32>");
+        define("mov_" + rn + "_ebp", { 0x89, 0xE8 + r }, "mov " + rn + ", ebp");
+        define(
+            "mov_" + rn + "_ref_" + rn,
+            { 0x8B, r << 3 | r },
+            "mov " + rn + ", [" + rn + "]");
+        define(
+            "mov_" + rn + "_ref_ebp_imm",
+            { 0x8B, 0x85 | r << 3 },
+            "mov " + rn + ", [ebp + <imm32>]");
+        define(
+            "add_" + rn + "_imm",
+            { 0x81, 0xC0 + r },
+            "add " + rn + ", <imm32>");
+        define(
+            "cmp_" + rn + "_imm",
+            { 0x81, 0xF8 + r },
+            "cmp " + rn + ", <imm32>");
+        define("neg_" + rn, { 0xF7, 0xD8 + r }, "neg " + rn);
+        define("not_" + rn, { 0xF7, 0xD0 + r }, "not " + rn);
+        define("push_" + rn, { 0x50 + r }, "push " + rn);
+        define("pop_" + rn, { 0x58 + r }, "pop " + rn);
+        define("jmp_" + rn, { 0xFF, 0xE0 + r }, "jmp " + rn);
+
+        if (registers[i] != Register::eax) {
+            define("xchg_eax_" + rn, { 0x90 + r }, "xchg eax, " + rn);
+        }
+
+        if (registers[i] <= Register::ebx) {
+            const std::string bn = byte_name(registers[i]);
+            for (const auto& [condition, opcode] : conditions) {
+                define(
+                    std::string { "set" } + condition + "_" + bn,
+                    { 0x0F, opcode, 0xC0 + r },
+                    std::string { "set" } + condition + " " + bn);
+            }
+            define(
+                "movzx_" + rn + "_" + bn,
+                { 0x0F, 0xB6, 0xC0 | r << 3 | r },
+                "movzx " + rn + ", " + bn);
+        }
+
+        for (std::size_t j = 0; j < registers.size(); ++j) {
+            if (i == j) {
+                continue;
+            }
+
+            const unsigned s = static_cast<unsigned>(registers[j]);
+            const std::string sn = name(registers[j]);
+
+            define(
+                "mov_" + rn + "_" + sn,
+                { 0x89, 0xC0 | s << 3 | r },
+                "mov " + rn + ", " + sn);
+            for (const auto& [operation, opcode] : operations) {
+                define(
+                    operation + ("_" + rn) + "_" + sn,
+                    { opcode, 0xC0 | s << 3 | r },
+                    operation + (" " + rn) + ", " + sn);
+            }
+            define(
+                "imul_" + rn + "_" + sn,
+                { 0x0F, 0xAF, 0xC0 | r << 3 | s },
+                "imul " + rn + ", " + sn);
+        }
+    }
+
+    define("idiv_ref_esp", { 0xF7, 0x3C, 0x24 }, "idiv dword [esp]");
+
+    text += "\n\n";
+    m_code.add_text(text);
 }
 
-void Compiler::operator()(const AddressOfExpression* node) {
-    address_of(node->m_variable_name);
-    m_writer << "push_eax\n";
+void Compiler::write_branch_macros() noexcept {
+    std::string text {};
+    text += "# Relative branches, see `relax_branches`\n";
+    define_macro(text, "jmp_rel8", { 0xEB }, "jmp <rel8>");
+    define_macro(text, "jmp_rel32", { 0xE9 }, "jmp <rel32>");
+    define_macro(text, "call_rel32", { 0xE8 }, "call <rel32>");
+
+    static const std::pair<const char*, unsigned> conditions[] = {
+        { "e", 0x4 },
+        { "ne", 0x5 },
+        { "l", 0xC },
+        { "ge", 0xD },
+        { "le", 0xE },
+        { "g", 0xF }
+    };
+
+    for (const auto& [condition, code] : conditions) {
+        const std::string jcc = std::string { "j" } + condition;
+        define_macro(text, jcc + "_rel8", { 0x70 | code }, jcc + " <rel8>");
+        define_macro(
+            text,
+            jcc + "_rel32",
+            { 0x0F, 0x80 | code },
+            jcc + " <rel32>");
+    }
+    text += "\n\n";
+    m_code.add_text(text);
 }
 
-void Compiler::operator()(const BinOpExpression* node) {
+void Compiler::find_reassigned() noexcept {
+    m_reassigned.assign(m_ast.symbols().size(), false);
+
+    for (NodeIndex node = 0; node < m_ast.size(); ++node) {
+        switch (m_ast.kind(node)) {
+        case NodeKind::let_statement:
+        case NodeKind::address_of:
+            m_reassigned[m_ast.symbol(node, 0)] = true;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void Compiler::number_registers() noexcept {
+    m_need.assign(m_ast.size(), 1);
+    m_pure.assign(m_ast.size(), true);
+
+    /* nodes are in pre-order, so children come after their parent */
+    for (NodeIndex node = m_ast.size(); node-- > 0;) {
+        switch (m_ast.kind(node)) {
+        case NodeKind::bin_op: {
+            const NodeIndex lhs = m_ast.child(node, 0);
+            const NodeIndex rhs = m_ast.child(node, 1);
+            m_need[node] = (m_need[lhs] == m_need[rhs])
+                ? m_need[lhs] + 1
+                : std::max(m_need[lhs], m_need[rhs]);
+            m_pure[node] = m_pure[lhs] && m_pure[rhs];
+            break;
+        }
+        case NodeKind::call:
+            /* arguments are evaluated with all registers */
+            m_need[node] = Registers::capacity;
+            m_pure[node] = false;
+            break;
+        case NodeKind::un_op:
+            m_need[node] = m_need[m_ast.child(node, 0)];
+            m_pure[node] = m_pure[m_ast.child(node, 0)];
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void Compiler::evaluate(NodeIndex node, const Registers& registers) {
+    const Register target = registers[0];
+
+    switch (m_ast.kind(node)) {
+    case NodeKind::address_of:
+        check_variable(node, m_ast.symbol(node, 0));
+        address_of(m_ast.symbol(node, 0), target);
+        break;
+    case NodeKind::bin_op:
+        evaluate_bin_op(node, registers);
+        break;
+    case NodeKind::call:
+        evaluate_call(node, registers);
+        break;
+    case NodeKind::numeral:
+        m_code.add(Opcode::mov_reg_imm, target, imm(m_ast.value(node)));
+        break;
+    case NodeKind::string: {
+        const Label data_begin = write_string(node, target);
+        m_code.add(Opcode::mov_reg_imm, target, data_begin);
+        break;
+    }
+    case NodeKind::un_op:
+        evaluate(m_ast.child(node, 0), registers);
+
+        if (m_ast.token(node) == Token::token_minus) {
+            m_code.add(Opcode::neg_reg, target);
+        }
+
+        if (m_ast.token(node) == Token::token_bit_not) {
+            m_code.add(Opcode::not_reg, target);
+        }
+
+        if (m_ast.token(node) == Token::token_log_not) {
+            m_code.add(Opcode::cmp_reg_imm, target, imm(0));
+            set_condition(Opcode::sete_byte, target);
+        }
+        break;
+    case NodeKind::variable:
+        check_variable(node, m_ast.symbol(node, 0));
+        address_of(m_ast.symbol(node, 0), target);
+        m_code.add(Opcode::mov_reg_ref_reg, target);
+        break;
+    default:
+        break;
+    }
+}
+
+void Compiler::evaluate_bin_op(NodeIndex node, const Registers& registers) {
+    evaluate_operands(node, registers);
+
+    const Register target = registers[0];
+    const Register source = registers[1];
+
+    switch (m_ast.token(node)) {
+    case Token::token_plus:
+        m_code.add(Opcode::add_reg_reg, target, source);
+        break;
+    case Token::token_minus:
+        m_code.add(Opcode::sub_reg_reg, target, source);
+        break;
+    case Token::token_multiply:
+        m_code.add(Opcode::imul_reg_reg, target, source);
+        break;
+    case Token::token_divide:
+    case Token::token_modulo:
+        evaluate_division(m_ast.token(node), registers);
+        break;
+    case Token::token_log_and:
+    case Token::token_log_or:
+        m_code.add(Opcode::cmp_reg_imm, target, imm(0));
+        set_condition(Opcode::setne_byte, target);
+        m_code.add(Opcode::cmp_reg_imm, source, imm(0));
+        set_condition(Opcode::setne_byte, source);
+        m_code.add(
+            (m_ast.token(node) == Token::token_log_and)
+                ? Opcode::and_reg_reg
+                : Opcode::or_reg_reg,
+            target,
+            source);
+        break;
+    case Token::token_bit_and:
+        m_code.add(Opcode::and_reg_reg, target, source);
+        break;
+    case Token::token_bit_or:
+        m_code.add(Opcode::or_reg_reg, target, source);
+        break;
+    case Token::token_bit_xor:
+        m_code.add(Opcode::xor_reg_reg, target, source);
+        break;
+    case Token::token_equal:
+        m_code.add(Opcode::cmp_reg_reg, target, source);
+        set_condition(Opcode::sete_byte, target);
+        break;
+    case Token::token_notequal:
+        m_code.add(Opcode::cmp_reg_reg, target, source);
+        set_condition(Opcode::setne_byte, target);
+        break;
+    case Token::token_less:
+        m_code.add(Opcode::cmp_reg_reg, target, source);
+        set_condition(Opcode::setl_byte, target);
+        break;
+    case Token::token_lessequal:
+        m_code.add(Opcode::cmp_reg_reg, target, source);
+        set_condition(Opcode::setle_byte, target);
+        break;
+    case Token::token_greater:
+        m_code.add(Opcode::cmp_reg_reg, target, source);
+        set_condition(Opcode::setg_byte, target);
+        break;
+    case Token::token_greaterequal:
+        m_code.add(Opcode::cmp_reg_reg, target, source);
+        set_condition(Opcode::setge_byte, target);
+        break;
+    default:
+        break;
+    }
+}
+
+void Compiler::evaluate_operands(
+        NodeIndex node,
+        const Registers& registers) {
+
+    const NodeIndex lhs = m_ast.child(node, 0);
+    const NodeIndex rhs = m_ast.child(node, 1);
+    const std::size_t available = registers.size();
+
+    /* a call in one operand may change the variables the other one reads */
+    const bool reorder = (m_pure[lhs] && m_pure[rhs]) ||
+        m_ast.kind(lhs) == NodeKind::numeral ||
+        m_ast.kind(lhs) == NodeKind::address_of;
+
+    if (m_need[lhs] < m_need[rhs] && m_need[lhs] < available && reorder) {
+        /* the order does not matter, evaluate the bigger operand first */
+        evaluate(rhs, registers.swapped());
+        evaluate(lhs, registers.without(1));
+    } else if (m_need[rhs] < available) {
+        evaluate(lhs, registers);
+        evaluate(rhs, registers.without(0));
+    } else {
+        /* out of registers, spill the lhs */
+        evaluate(lhs, registers);
+        m_code.add(Opcode::push_reg, registers[0]);
+        evaluate(rhs, registers);
+        m_code.add(Opcode::mov_reg_reg, registers[1], registers[0]);
+        m_code.add(Opcode::pop_reg, registers[0]);
+    }
+}
+
+void Compiler::evaluate_division(
+        Token token,
+        const Registers& registers) noexcept {
+
+    const Register target = registers[0];
+    const Register result = (token == Token::token_divide)
+        ? Register::eax
+        : Register::edx;
+
+    /* idiv needs eax and edx, save them if they hold other values */
+    const bool save_eax = !registers.contains(Register::eax);
+    const bool save_edx = !registers.contains(Register::edx);
+
+    if (save_eax) {
+        m_code.add(Opcode::push_reg, Register::eax);
+    }
+
+    if (save_edx) {
+        m_code.add(Opcode::push_reg, Register::edx);
+    }
+
+    /* divide by the value on top of the stack */
+    m_code.add(Opcode::push_reg, registers[1]);
+    if (target != Register::eax) {
+        m_code.add(Opcode::mov_reg_reg, Register::eax, target);
+    }
+    m_code.add(Opcode::cdq);
+    m_code.add(Opcode::idiv_ref_esp);
+    m_code.add(Opcode::add_reg_imm, Register::esp, imm(4));
+
+    if (target != result) {
+        m_code.add(Opcode::mov_reg_reg, target, result);
+    }
+
+    if (save_edx) {
+        m_code.add(Opcode::pop_reg, Register::edx);
+    }
+
+    if (save_eax) {
+        m_code.add(Opcode::pop_reg, Register::eax);
+    }
+}
+
+void Compiler::evaluate_call(NodeIndex node, const Registers& registers) {
+    check_variable(node, m_ast.symbol(node, 0));
+
+    /* save registers that hold values of enclosing expressions */
+    const Registers all = Registers::all();
+    for (std::size_t i = 0; i < all.size(); ++i) {
+        if (!registers.contains(all[i])) {
+            m_code.add(Opcode::push_reg, all[i]);
+        }
+    }
+
+    /* put arguments on the stack, right to left */
+    const FlatList arguments = m_ast.list(node, 1);
+    for (std::size_t i = arguments.size(); i > 0; --i) {
+        evaluate(arguments[i - 1], all);
+        m_code.add(Opcode::push_reg, Register::eax);
+    }
+
+    /* call function */
+    call(m_ast.symbol(node, 0));
+    m_code.add(Opcode::add_reg_imm, Register::esp, imm(arguments.size() * 4));
+
+    /* return value */
+    if (registers[0] != Register::eax) {
+        m_code.add(Opcode::mov_reg_reg, registers[0], Register::eax);
+    }
+
+    for (std::size_t i = all.size(); i > 0; --i) {
+        if (!registers.contains(all[i - 1])) {
+            m_code.add(Opcode::pop_reg, all[i - 1]);
+        }
+    }
+}
+
+void Compiler::set_condition(Opcode set_byte, Register reg) noexcept {
+    if (reg <= Register::ebx) {
+        m_code.add(set_byte, reg);
+        m_code.add(Opcode::movzx_reg_byte, reg);
+        return;
+    }
+
+    /* no byte form, go through al */
+    m_code.add(Opcode::xchg_reg_reg, Register::eax, reg);
+    m_code.add(set_byte, Register::eax);
+    m_code.add(Opcode::movzx_reg_byte, Register::eax);
+    m_code.add(Opcode::xchg_reg_reg, Register::eax, reg);
+}
+
+static bool is_comparison(Token token) noexcept {
+    switch (token) {
+    case Token::token_equal:
+    case Token::token_notequal:
+    case Token::token_less:
+    case Token::token_lessequal:
+    case Token::token_greater:
+    case Token::token_greaterequal:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Branch taken if a comparison holds, or if it does not hold. */
+static Opcode branch_on(Token comparison, bool holds) noexcept {
+    switch (comparison) {
+    case Token::token_equal:
+        return holds ? Opcode::je_rel8 : Opcode::jne_rel8;
+    case Token::token_notequal:
+        return holds ? Opcode::jne_rel8 : Opcode::je_rel8;
+    case Token::token_less:
+        return holds ? Opcode::jl_rel8 : Opcode::jge_rel8;
+    case Token::token_lessequal:
+        return holds ? Opcode::jle_rel8 : Opcode::jg_rel8;
+    case Token::token_greater:
+        return holds ? Opcode::jg_rel8 : Opcode::jle_rel8;
+    default:
+        return holds ? Opcode::jge_rel8 : Opcode::jl_rel8;
+    }
+}
+
+void Compiler::branch_if_false(NodeIndex condition, Label target) {
+    if (!m_options.m_registers || !m_options.m_relative_branches) {
+        visit(condition);
+        jump_if_false(target);
+        return;
+    }
+
+    /* e.g. "while (1)", or a condition that was folded */
+    if (m_ast.kind(condition) == NodeKind::numeral) {
+        if (m_ast.value(condition) == 0) {
+            jump(target);
+        }
+        return;
+    }
+
+    /* "!x" is false if x holds */
+    bool holds = false;
+    if (m_ast.kind(condition) == NodeKind::un_op &&
+            m_ast.token(condition) == Token::token_log_not) {
+        condition = m_ast.child(condition, 0);
+        holds = true;
+    }
+
+    const Registers registers = Registers::all();
+
+    if (m_ast.kind(condition) == NodeKind::bin_op &&
+            is_comparison(m_ast.token(condition))) {
+        const NodeIndex rhs = m_ast.child(condition, 1);
+        if (m_ast.kind(rhs) == NodeKind::numeral) {
+            evaluate(m_ast.child(condition, 0), registers);
+            m_code.add(
+                Opcode::cmp_reg_imm,
+                registers[0],
+                imm(m_ast.value(rhs)));
+        } else {
+            evaluate_operands(condition, registers);
+            m_code.add(Opcode::cmp_reg_reg, registers[0], registers[1]);
+        }
+
+        m_code.add(branch_on(m_ast.token(condition), holds), target);
+        return;
+    }
+
+    evaluate(condition, registers);
+    m_code.add(Opcode::cmp_reg_imm, registers[0], imm(0));
+    m_code.add(holds ? Opcode::jne_rel8 : Opcode::je_rel8, target);
+}
+
+Label Compiler::write_string(NodeIndex node, Register reg) noexcept {
+    const Label data_begin = next_unique_label();
+    const Label data_end = next_unique_label();
+
+    /* jump over data, through `reg` as eax may be in use */
+    if (m_options.m_relative_branches) {
+        jump(data_end);
+    } else {
+        m_code.add(Opcode::mov_reg_imm, reg, data_end);
+        m_code.add(Opcode::jmp_reg, reg);
+    }
+    m_code.define(data_begin);
+
+    /* emit string data (null terminated) */
+    const std::string_view string = m_ast.string(node, 0);
+    std::string data { string.begin(), string.end() };
+    data += '\0';
+    m_code.add_data(data);
+
+    m_code.define(data_end);
+
+    return data_begin;
+}
+
+void Compiler::visit_address_of(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
+    address_of(m_ast.symbol(node, 0));
+    m_code.add(Opcode::push_reg, Register::eax);
+}
+
+void Compiler::visit_bin_op(NodeIndex node) {
         /* save ebx */
-        m_writer << "push_ebx\n";
+        m_code.add(Opcode::push_reg, Register::ebx);
 
         /* put lhs into eax, rhs into ebx */
-        node->m_lhs->visit(*this);
-        node->m_rhs->visit(*this);
-        m_writer
-            << "pop_ebx\n"
-            << "pop_eax\n";
+        visit(m_ast.child(node, 0));
+        visit(m_ast.child(node, 1));
+        m_code.add(Opcode::pop_reg, Register::ebx);
+        m_code.add(Opcode::pop_reg, Register::eax);
 
-        switch (node->m_token) {
+        switch (m_ast.token(node)) {
         case Token::token_plus:
-            m_writer << "add_eax_ebx\n";
+            m_code.add(Opcode::add_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_minus:
-            m_writer << "sub_eax_ebx\n";
+            m_code.add(Opcode::sub_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_multiply:
-            m_writer << "imul_eax_ebx\n";
+            m_code.add(Opcode::imul_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_divide:
-            m_writer
-                << "push_edx\n"
-                << "cdq\n"
-                << "idiv_ebx\n"
-                << "pop_edx\n";
+            m_code.add(Opcode::push_reg, Register::edx);
+            m_code.add(Opcode::cdq);
+            m_code.add(Opcode::idiv_reg, Register::ebx);
+            m_code.add(Opcode::pop_reg, Register::edx);
             break;
         case Token::token_modulo:
-            m_writer
-                << "push_edx\n"
-                << "cdq\n"
-                << "idiv_ebx\n"
-                << "mov_eax_edx\n"
-                << "pop_edx\n";
+            m_code.add(Opcode::push_reg, Register::edx);
+            m_code.add(Opcode::cdq);
+            m_code.add(Opcode::idiv_reg, Register::ebx);
+            m_code.add(Opcode::mov_reg_reg, Register::eax, Register::edx);
+            m_code.add(Opcode::pop_reg, Register::edx);
             break;
         case Token::token_log_and:
-            m_writer
-                << "cmp_eax_imm 00 00 00 00\n"
-                << "setne_al\n"
-                << "movzx_eax_al\n"
-                << "cmp_ebx_imm 00000000\n"
-                << "setne_bl\n"
-                << "movzx_ebx_bl\n"
-                << "and_eax_ebx\n";
+            m_code.add(
+                Opcode::cmp_reg_imm,
+                Register::eax,
+                Immediate { 0, true });
+            m_code.add(Opcode::setne_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
+            m_code.add(Opcode::cmp_reg_imm, Register::ebx, imm(0));
+            m_code.add(Opcode::setne_byte, Register::ebx);
+            m_code.add(Opcode::movzx_reg_byte, Register::ebx);
+            m_code.add(Opcode::and_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_log_or:
-            m_writer
-                << "cmp_eax_imm 00000000\n"
-                << "setne_al\n"
-                << "movzx_eax_al\n"
-                << "cmp_ebx_imm 00000000\n"
-                << "setne_bl\n"
-                << "movzx_ebx_bl\n"
-                << "or_eax_ebx\n";
+            m_code.add(Opcode::cmp_reg_imm, Register::eax, imm(0));
+            m_code.add(Opcode::setne_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
+            m_code.add(Opcode::cmp_reg_imm, Register::ebx, imm(0));
+            m_code.add(Opcode::setne_byte, Register::ebx);
+            m_code.add(Opcode::movzx_reg_byte, Register::ebx);
+            m_code.add(Opcode::or_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_bit_and:
-            m_writer << "and_eax_ebx\n";
+            m_code.add(Opcode::and_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_bit_or:
-            m_writer << "or_eax_ebx\n";
+            m_code.add(Opcode::or_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_bit_xor:
-            m_writer << "xor_eax_ebx\n";
+            m_code.add(Opcode::xor_reg_reg, Register::eax, Register::ebx);
             break;
         case Token::token_equal:
-            m_writer
-                << "cmp_eax_ebx\n"
-                << "sete_al\n"
-                << "movzx_eax_al\n";
+            m_code.add(Opcode::cmp_reg_reg, Register::eax, Register::ebx);
+            m_code.add(Opcode::sete_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
             break;
         case Token::token_notequal:
-            m_writer
-                << "cmp_eax_ebx\n"
-                << "setne_al\n"
-                << "movzx_eax_al\n";
+            m_code.add(Opcode::cmp_reg_reg, Register::eax, Register::ebx);
+            m_code.add(Opcode::setne_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
             break;
         case Token::token_less:
-            m_writer
-                << "cmp_eax_ebx\n"
-                << "setl_al\n"
-                << "movzx_eax_al\n";
+            m_code.add(Opcode::cmp_reg_reg, Register::eax, Register::ebx);
+            m_code.add(Opcode::setl_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
             break;
         case Token::token_lessequal:
-            m_writer
-                << "cmp_eax_ebx\n"
-                << "setle_al\n"
-                << "movzx_eax_al\n";
+            m_code.add(Opcode::cmp_reg_reg, Register::eax, Register::ebx);
+            m_code.add(Opcode::setle_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
             break;
         case Token::token_greater:
-            m_writer
-                << "cmp_eax_ebx\n"
-                << "setg_al\n"
-                << "movzx_eax_al\n";
+            m_code.add(Opcode::cmp_reg_reg, Register::eax, Register::ebx);
+            m_code.add(Opcode::setg_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
             break;
         case Token::token_greaterequal:
-            m_writer
-                << "cmp_eax_ebx\n"
-                << "setge_al\n"
-                << "movzx_eax_al\n";
+            m_code.add(Opcode::cmp_reg_reg, Register::eax, Register::ebx);
+            m_code.add(Opcode::setge_byte, Register::eax);
+            m_code.add(Opcode::movzx_reg_byte, Register::eax);
             break;
         }
 
         /* restore ebx */
-        m_writer << "pop_ebx\n";
+        m_code.add(Opcode::pop_reg, Register::ebx);
 
-        m_writer << "push_eax\n";
+        m_code.add(Opcode::push_reg, Register::eax);
 }
 
-void Compiler::operator()(const BreakStatement* /* node */) {
-    m_writer << "mov_eax_imm " << m_break_label << "\n";
-    m_writer << "jmp_eax\n";
+void Compiler::visit_break(NodeIndex node) {
+    if (m_diagnostics != nullptr && m_break_label == Label::none) {
+        outside_loop(*m_diagnostics, m_ast, node);
+    }
+
+    jump(m_break_label);
 }
 
-void Compiler::operator()(const CallExpression* node) {
+void Compiler::visit_call(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
+
     /* put arguments on the stack, right to left */
-    for (
-            auto it = node->m_arguments.rbegin();
-            it != node->m_arguments.rend();
-            ++it) {
-        (*it)->visit(*this);
+    const FlatList arguments = m_ast.list(node, 1);
+    for (std::size_t i = arguments.size(); i > 0; --i) {
+        visit(arguments[i - 1]);
     }
 
     /* call function */
-    address_of(node->m_variable_name);
-    m_writer << "call_ref_eax\n";
+    call(m_ast.symbol(node, 0));
 
     /* clean up stack */
-    m_writer << "add_esp_imm " << as_imm(node->m_arguments.size() * 4) << "\n";
+    m_code.add(Opcode::add_reg_imm, Register::esp, imm(arguments.size() * 4));
 
     /* return value */
-    m_writer << "push_eax\n";
+    m_code.add(Opcode::push_reg, Register::eax);
 }
 
-void Compiler::operator()(const ContinueStatement* node) {
-    m_writer << "mov_eax_imm " << m_continue_label << "\n";
-    m_writer << "jmp_eax\n";
+void Compiler::visit_continue(NodeIndex node) {
+    if (m_diagnostics != nullptr && m_continue_label == Label::none) {
+        outside_loop(*m_diagnostics, m_ast, node);
+    }
+
+    jump(m_continue_label);
 }
 
-void Compiler::operator()(const ExpressionStatement* node) {
+void Compiler::visit_expression_statement(NodeIndex node) {
     /* calculate expression */
-    node->m_expression->visit(*this);
+    visit(m_ast.child(node, 0));
 
     /* discard result */
-    m_writer << "pop_eax\n";
+    m_code.add(Opcode::pop_reg, Register::eax);
 }
 
-void Compiler::operator()(const ForStatement* node) {
-    const std::string for_begin = next_unique_label();
-    const std::string for_continue = next_unique_label();
-    const std::string for_end = next_unique_label();
+void Compiler::visit_for(NodeIndex node) {
+    const Label for_begin = next_unique_label();
+    const Label for_continue = next_unique_label();
+    const Label for_end = next_unique_label();
+
+    const FlatList clauses = m_ast.list(node, 1);
 
-    Compiler inner = with_break_continue_label(for_end, for_continue);
+    /* the loop variable is not yet visible in the initial value */
+    m_code.add(Opcode::push_reg, Register::ebx);
+    visit(clauses[0]);
+
+    Block outer = enter_block();
+    m_break_label = for_end;
+    m_continue_label = for_continue;
 
     /* setup and initialize loop variable */
-    inner.m_localvars[node->m_variable_name] = next_local_offset();
-    m_writer
-        << "push_imm 00000000\n"
-        << "push_ebx\n";
-    node->m_initial->visit(*this);
-    m_writer << "pop_ebx\n";
-    inner.address_of(node->m_variable_name);
-    m_writer
-        << "mov_ref_eax_ebx\n"
-        << "pop_ebx\n";
+    check_unique(node, m_ast.symbol(node, 0));
+    add_local(m_ast.symbol(node, 0), m_frame_offsets[node]);
+    m_code.add(Opcode::pop_reg, Register::ebx);
+    address_of(m_ast.symbol(node, 0));
+    m_code.add(Opcode::mov_ref_reg_reg, Register::eax, Register::ebx);
+    m_code.add(Opcode::pop_reg, Register::ebx);
 
     /* condition */
-    m_writer << '.' << for_begin << ":\n";
-    node->m_condition->visit(inner);
-    m_writer
-        << "pop_eax\n"
-        << "cmp_eax_imm 00 00 00 00\n"
-        << "hop_ne\n"
-        << "mov_eax_imm " << for_end << '\n'
-        << "jmp_eax\n";
+    m_code.define(for_begin);
+    branch_if_false(clauses[1], for_end);
 
     /* loop body */
-    for (auto& i : node->m_statements) {
-        i->visit(inner);
+    for (const NodeIndex statement : m_ast.list(node, 2)) {
+        visit(statement);
     }
 
     /* update */
-    m_writer
-        << '.' << for_continue << ":\n"
-        << "push_ebx\n";
-    node->m_update->visit(inner);
-    m_writer << "pop_ebx\n";
-    inner.address_of(node->m_variable_name);
-    m_writer
-        << "mov_ref_eax_ebx\n"
-        << "pop_ebx\n";
+    m_code.define(for_continue);
+    m_code.add(Opcode::push_reg, Register::ebx);
+    visit(clauses[2]);
+    m_code.add(Opcode::pop_reg, Register::ebx);
+    address_of(m_ast.symbol(node, 0));
+    m_code.add(Opcode::mov_ref_reg_reg, Register::eax, Register::ebx);
+    m_code.add(Opcode::pop_reg, Register::ebx);
 
-    /* loop back */
-    m_writer
-        << "mov_eax_imm " << for_begin << '\n'
-        << "jmp_eax\n";
+    leave_block(std::move(outer));
 
-    /* remove loop variable */
-    m_writer
-        << '.' << for_end << ":\n"
-        << "pop_eax\n";
+    /* loop back */
+    jump(for_begin);
+    m_code.define(for_end);
 }
 
-void Compiler::operator()(const Function* node) {
-    const std::string fun_begin = next_unique_label();
-    const std::string fun_end = next_unique_label();
-    const std::string fun_entry = next_unique_label();
-    const std::string fun_return = next_unique_label();
-    m_globalvars[node->m_name] = fun_begin;
+void Compiler::visit_function(NodeIndex node) {
+    const Label fun_begin = next_unique_label();
+    const Label fun_end = next_unique_label();
+    const Label fun_entry = next_unique_label();
+    const Label fun_return = next_unique_label();
+    const Symbol name = m_ast.symbol(node, 0);
+    check_unique(node, name);
+    m_globalvars[name] = fun_begin;
+
+    /* known before the body, so that recursive calls are direct too */
+    if (m_options.m_direct_calls && !m_reassigned[name]) {
+        m_entries[name] = fun_entry;
+    }
 
     /* register arguments as local variables */
-    m_localvars.clear();
-    for (int i = 0; i < static_cast<int>(node->m_arguments.size()); ++i) {
-        m_localvars[node->m_arguments[i]] = 8 + 4 * i;
-    }
-
-    m_writer
-        << "\n"
-        << "##\n"
-        << "## Function \"" << node->m_name << "\"\n"
-        << "##\n"
-        << "\n"
-        << "mov_eax_imm " << fun_end << '\n'
-        << "jmp_eax\n"
-        << '.' << fun_begin << ":\n"
-        << "00 00 00 00\n"
-        << '.' << fun_entry << ":\n"
-        << "push_ebp\n"
-        << "mov_ebp_esp\n";
-
-    Compiler inner = with_return_label(fun_return);
-    for (auto& statement : node->m_statements) {
-        statement->visit(inner);
-    }
-
-    m_writer
-        /* set up default return value. */
-        << "push_imm 00 00 00 00\n"
-        /* "return" statements jumps here. expects return value on stack. */
-        << '.' << fun_return << ":\n"
-        << "pop_eax\n"
-        /* tear down stack frame. */
-        << "mov_esp_ebp\n"
-        << "pop_ebp\n"
-        /* leave function. */
-        << "ret\n";
-
-    m_writer
-        /* initialize function ptr variable */
-        << '.' << fun_end << ":\n"
-        << "mov_eax_imm " << fun_entry << '\n'
-        << "mov_ebx_eax\n"
-        << "mov_eax_imm " << fun_begin << '\n'
-        << "mov_ref_eax_ebx\n";
-}
-
-void Compiler::operator()(const GlobalVar* node) {
-    const std::string var_begin = next_unique_label();
-    const std::string var_end = next_unique_label();
-    m_globalvars[node->m_name] = var_begin;
-
-    m_writer
-        << "\n"
-        << "##\n"
-        << "## GlobalVar \"" << node->m_name << "\"\n"
-        << "##\n"
-        << "\n";
+    Block outer = enter_block();
+    m_return_label = fun_return;
+    const FlatList arguments = m_ast.list(node, 1);
+    for (int i = 0; i < static_cast<int>(arguments.size()); ++i) {
+        check_unique(node, arguments[i]);
+        add_local(arguments[i], 8 + 4 * i);
+    }
+
+    comment_header("Function", name);
+    jump(fun_end);
+    m_code.define(fun_begin);
+    m_code.add_data({ "\0\0\0\0", 4 });
+    m_code.define(fun_entry);
+    m_code.add(Opcode::push_reg, Register::ebp);
+    m_code.add(Opcode::mov_reg_reg, Register::ebp, Register::esp);
+
+    /* reserve the slots of all local variables at once */
+    const int frame_size = -layout_frame(m_ast.list(node, 2), 0);
+    if (frame_size > 0) {
+        m_code.add(Opcode::sub_reg_imm, Register::esp, imm(frame_size));
+    }
+
+    for (const NodeIndex statement : m_ast.list(node, 2)) {
+        visit(statement);
+    }
+
+    leave_block(std::move(outer));
+
+    /* set up default return value. */
+    m_code.add(Opcode::push_imm, Immediate { 0, true });
+
+    /* "return" statements jumps here. expects return value on stack. */
+    m_code.define(fun_return);
+    m_code.add(Opcode::pop_reg, Register::eax);
+
+    /* tear down stack frame. */
+    m_code.add(Opcode::mov_reg_reg, Register::esp, Register::ebp);
+    m_code.add(Opcode::pop_reg, Register::ebp);
+
+    /* leave function. */
+    m_code.add(Opcode::ret);
+
+    /* initialize function ptr variable */
+    m_code.define(fun_end);
+    m_code.add(Opcode::mov_reg_imm, Register::eax, fun_entry);
+    m_code.add(Opcode::mov_reg_reg, Register::ebx, Register::eax);
+    m_code.add(Opcode::mov_reg_imm, Register::eax, fun_begin);
+    m_code.add(Opcode::mov_ref_reg_reg, Register::eax, Register::ebx);
+}
+
+void Compiler::visit_global_var(NodeIndex node) {
+    const Label var_begin = next_unique_label();
+    const Label var_end = next_unique_label();
+    check_unique(node, m_ast.symbol(node, 0));
+    m_globalvars[m_ast.symbol(node, 0)] = var_begin;
+
+    comment_header("GlobalVar", m_ast.symbol(node, 0));
 
     /* define and jump over memory location where variable is stored */
-    m_writer
-        << "mov_eax_imm " << var_end << '\n'
-        << "jmp_eax\n"
-        << '.' << var_begin << ":\n"
-        << "00 00 00 00\n"
-        << '.' << var_end << ":\n";
+    jump(var_end);
+    m_code.define(var_begin);
+    m_code.add_data({ "\0\0\0\0", 4 });
+    m_code.define(var_end);
 
     /* push initial value to the stack */
-    node->m_value->visit(*this);
+    visit(m_ast.child(node, 1));
 
     /* store value */
-    m_writer
-        << "pop_ebx\n"
-        << "mov_eax_imm " << var_begin << '\n'
-        << "mov_ref_eax_ebx\n";
+    m_code.add(Opcode::pop_reg, Register::ebx);
+    m_code.add(Opcode::mov_reg_imm, Register::eax, var_begin);
+    m_code.add(Opcode::mov_ref_reg_reg, Register::eax, Register::ebx);
 }
 
-void Compiler::operator()(const IfStatement* node) {
-    const std::string else_begin = next_unique_label();
-    const std::string if_end = next_unique_label();
+void Compiler::visit_if(NodeIndex node) {
+    const Label else_begin = next_unique_label();
+    const Label if_end = next_unique_label();
 
-    node->m_condition->visit(*this);
+    branch_if_false(m_ast.child(node, 0), else_begin);
 
-    m_writer
-        << "pop_eax\n"
-        << "cmp_eax_imm 00 00 00 00\n"
-        << "hop_ne\n"
-        << "mov_eax_imm " << else_begin << '\n'
-        << "jmp_eax\n";
-
-    Compiler inner_then = with_return_label(m_return_label);
-    for (auto& statement : node->m_then_statements) {
-        statement->visit(inner_then);
+    Block outer_then = enter_block();
+    for (const NodeIndex statement : m_ast.list(node, 1)) {
+        visit(statement);
     }
+    leave_block(std::move(outer_then));
 
-    m_writer
-        << "mov_eax_imm " << if_end << '\n'
-        << "jmp_eax\n"
-        << '.' << else_begin << ":\n";
+    jump(if_end);
+    m_code.define(else_begin);
 
-    Compiler inner_else = with_return_label(m_return_label);
-    for (auto& statement : node->m_else_statements) {
-        statement->visit(inner_else);
+    Block outer_else = enter_block();
+    for (const NodeIndex statement : m_ast.list(node, 2)) {
+        visit(statement);
     }
+    leave_block(std::move(outer_else));
 
-    m_writer << '.' << if_end << ":\n";
+    m_code.define(if_end);
 }
 
-void Compiler::operator()(const LetStatement* node) {
+void Compiler::visit_let(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
+
     /* save ebx */
-    m_writer << "push_ebx\n";
+    m_code.add(Opcode::push_reg, Register::ebx);
 
     /* put value into ebx */
-    node->m_expression->visit(*this);
-    m_writer << "pop_ebx\n";
+    visit(m_ast.child(node, 1));
+    m_code.add(Opcode::pop_reg, Register::ebx);
 
     /* put target address into eax */
-    address_of(node->m_variable_name);
+    address_of(m_ast.symbol(node, 0));
 
     /* store */
-    m_writer << "mov_ref_eax_ebx\n";
+    m_code.add(Opcode::mov_ref_reg_reg, Register::eax, Register::ebx);
 
     /* restore ebx */
-    m_writer << "pop_ebx\n";
+    m_code.add(Opcode::pop_reg, Register::ebx);
 }
 
-void Compiler::operator()(const NumeralExpression* node) {
-    m_writer << "push_imm " << as_imm(node->m_value) << '\n';
+void Compiler::visit_numeral(NodeIndex node) {
+    m_code.add(Opcode::push_imm, imm(m_ast.value(node)));
 }
 
-void Compiler::operator()(const Program* node) {
-    m_writer << hex_compiler_header;
+void Compiler::visit_program() {
+    m_code.add_text(hex_elf_header);
+    m_code.add_text(hex_compiler_header);
 
-    for (auto& i : node->m_globalvars) {
-        i.visit(*this);
+    if (m_options.m_registers) {
+        write_register_macros();
     }
 
-    for (auto& i : node->m_functions) {
-        i.visit(*this);
+    if (m_options.m_relative_branches || m_options.m_direct_calls) {
+        write_branch_macros();
     }
 
-    m_writer
-        << "\n"
-        << "# Call main\n"
-        << "mov_eax_imm " << m_globalvars["main"] << "\n"
-        << "call_ref_eax\n"
-        << "\n"
-        << "# Terminate\n"
-        << "mov_ebx_eax\n"
-        << "mov_eax_imm 01 00 00 00\n"
-        << "int_80\n";
-}
+    for (const NodeIndex globalvar : m_ast.globalvars()) {
+        visit(globalvar);
+    }
 
-void Compiler::operator()(const ReturnStatement* node) {
-    node->m_expression->visit(*this);
+    for (const NodeIndex function : m_ast.functions()) {
+        visit(function);
+    }
 
-    m_writer
-        << "mov_eax_imm " << m_return_label << '\n'
-        << "jmp_eax\n";
-}
+    if (m_diagnostics != nullptr) {
+        check_main(*m_diagnostics, m_ast);
+    }
 
-void Compiler::operator()(const StringExpression* node) {
-    const std::string data_begin = next_unique_label();
-    const std::string data_end = next_unique_label();
+    const Symbol main = m_ast.symbols().find("main");
+    if (main == SymbolTable::no_symbol) {
+        return;
+    }
 
-    /* jump over data */
-    m_writer
-        << "mov_eax_imm " << data_end << '\n'
-        << "jmp_eax\n"
-        << '.' << data_begin << ":\n";
+    m_code.add_text("\n# Call main\n");
+    call(main);
 
-    /* emit string data (null terminated) */
-    for (const auto c : node->m_value) {
-        m_writer << byte_to_upper_hex(0xff & c) << ' ';
-    }
-    m_writer << "00\n";
+    m_code.add_text("\n# Terminate\n");
+    m_code.add(Opcode::mov_reg_reg, Register::ebx, Register::eax);
+    m_code.add(Opcode::mov_reg_imm, Register::eax, Immediate { 1, true });
+    m_code.add(Opcode::int_80);
+}
+
+void Compiler::visit_return(NodeIndex node) {
+    visit(m_ast.child(node, 0));
+    jump(m_return_label);
+}
+
+void Compiler::visit_string(NodeIndex node) {
+    const Label data_begin = write_string(node, Register::eax);
 
     /* store address */
-    m_writer
-        << '.' << data_end << ":\n"
-        << "push_imm " << data_begin << '\n';
+    m_code.add(Opcode::push_imm, data_begin);
 }
 
-void Compiler::operator()(const UnOpExpression* node) {
-    node->m_rhs->visit(*this);
-    m_writer << "pop_eax\n";
+void Compiler::visit_un_op(NodeIndex node) {
+    visit(m_ast.child(node, 0));
+    m_code.add(Opcode::pop_reg, Register::eax);
 
-    if (node->m_token == Token::token_minus) {
-        m_writer << "neg_eax\n";
+    if (m_ast.token(node) == Token::token_minus) {
+        m_code.add(Opcode::neg_reg, Register::eax);
     }
 
-    if (node->m_token == Token::token_bit_not) {
-        m_writer << "not_eax\n";
+    if (m_ast.token(node) == Token::token_bit_not) {
+        m_code.add(Opcode::not_reg, Register::eax);
     }
 
-    if (node->m_token == Token::token_log_not) {
-        m_writer
-        << "cmp_eax_imm 00 00 00 00\n"
-        << "sete_al\n"
-        << "movzx_eax_al\n";
+    if (m_ast.token(node) == Token::token_log_not) {
+        m_code.add(Opcode::cmp_reg_imm, Register::eax, Immediate { 0, true });
+        m_code.add(Opcode::sete_byte, Register::eax);
+        m_code.add(Opcode::movzx_reg_byte, Register::eax);
     }
 
-    m_writer << "push_eax\n";
+    m_code.add(Opcode::push_reg, Register::eax);
 }
 
-void Compiler::operator()(const VariableExpression* node) {
-    address_of(node->m_variable_name);
-    m_writer
-        << "mov_eax_ref_eax\n"
-        << "push_eax\n";
+void Compiler::visit_variable(NodeIndex node) {
+    check_variable(node, m_ast.symbol(node, 0));
+    address_of(m_ast.symbol(node, 0));
+    m_code.add(Opcode::mov_reg_ref_reg, Register::eax);
+    m_code.add(Opcode::push_reg, Register::eax);
 }
 
-void Compiler::operator()(const VarStatement* node) {
-    m_localvars[node->m_variable_name] = next_local_offset();
-    m_writer << "push_imm 00 00 00 00\n";
-
+void Compiler::visit_var(NodeIndex node) {
     /* save ebx */
-    m_writer << "push_ebx\n";
+    m_code.add(Opcode::push_reg, Register::ebx);
 
-    node->m_expression->visit(*this);
+    /* the variable is not yet visible in its initial value */
+    visit(m_ast.child(node, 1));
+    check_unique(node, m_ast.symbol(node, 0));
+    add_local(m_ast.symbol(node, 0), m_frame_offsets[node]);
 
     /* value in ebx */
-    m_writer << "pop_ebx\n";
+    m_code.add(Opcode::pop_reg, Register::ebx);
 
     /* address in eax */
-    address_of(node->m_variable_name);
+    address_of(m_ast.symbol(node, 0));
 
     /* store */
-    m_writer << "mov_ref_eax_ebx\n";
+    m_code.add(Opcode::mov_ref_reg_reg, Register::eax, Register::ebx);
 
     /* restore ebx */
-    m_writer << "pop_ebx\n";
+    m_code.add(Opcode::pop_reg, Register::ebx);
 }
 
-void Compiler::operator()(const WhileStatement* node) {
-    const std::string while_begin = next_unique_label();
-    const std::string while_end = next_unique_label();
-
-    m_writer << '.' << while_begin << ":\n";
+void Compiler::visit_while(NodeIndex node) {
+    const Label while_begin = next_unique_label();
+    const Label while_end = next_unique_label();
 
-    node->m_condition->visit(*this);
+    m_code.define(while_begin);
 
-    m_writer
-        << "pop_eax\n"
-        << "cmp_eax_imm 00 00 00 00\n"
-        << "hop_ne\n"
-        << "mov_eax_imm " << while_end << '\n'
-        << "jmp_eax\n";
+    branch_if_false(m_ast.child(node, 0), while_end);
 
-    Compiler inner = with_break_continue_label(while_end, while_begin);
-    for (auto& i : node->m_statements) {
-        i->visit(inner);
+    Block outer = enter_block();
+    m_break_label = while_end;
+    m_continue_label = while_begin;
+    for (const NodeIndex statement : m_ast.list(node, 1)) {
+        visit(statement);
     }
+    leave_block(std::move(outer));
 
-    m_writer
-        << "mov_eax_imm " << while_begin << '\n'
-        << "jmp_eax\n"
-        << '.' << while_end << ":\n";
+    jump(while_begin);
+    m_code.define(while_end);
 }
 
 } /* namespace arabilis */
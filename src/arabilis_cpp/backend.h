@@ -5,6 +5,9 @@
 #define BACKEND_H_
 
 #include "ast.h"
+#include "diagnostics.h"
+#include "flat_ast.h"
+#include "ir.h"
 
 namespace arabilis {
 
@@ -41,8 +44,50 @@ public:
     virtual void operator()(const WhileStatement*) = 0;
 };
 
-void check_variable_usage(Program&) noexcept;
-void compile_program(Program&, Writer&) noexcept;
+/*
+ * Check that names are declared before use and only once, and that "break"
+ * and "continue" are inside loops. Globals are registered serially, then
+ * the function bodies are checked in `jobs` threads. Errors are reported in
+ * source order, regardless of the number of threads.
+ */
+void check_variable_usage(
+        const FlatAst&,
+        Diagnostics&,
+        unsigned jobs = 1) noexcept;
+
+struct CompileOptions {
+    /*
+     * Evaluate expressions in registers, allocated by Sethi-Ullman numbers,
+     * instead of on the stack. Spills to the stack if registers run out.
+     */
+    bool m_registers { false };
+
+    /*
+     * Jump with relative branches instead of through eax. The code must go
+     * through `relax_branches` before it is printed.
+     */
+    bool m_relative_branches { false };
+
+    /*
+     * Call functions that are never assigned with "let" nor have their address
+     * taken with "&" relatively instead of through their cell. The code must go
+     * through `relax_branches` before it is printed.
+     */
+    bool m_direct_calls { false };
+};
+
+/* Compile a program that passed `check_variable_usage`, see `print`. */
+[[nodiscard]] Code compile_program(
+        const FlatAst&,
+        const CompileOptions& = {}) noexcept;
+
+/*
+ * Check and compile a program in one traversal. Reports the same errors as
+ * `check_variable_usage`. The code is incomplete if there were errors.
+ */
+[[nodiscard]] Code check_and_compile_program(
+        const FlatAst&,
+        Diagnostics&) noexcept;
 
 } /* namespace arabilis */
 
@@ -0,0 +1,405 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+/*
+ * Micro-benchmark for tree traversal. Generates a large program, then walks
+ * it once through the `Visitor` of the pointer-based AST and once with a
+ * switch over the flat AST. Both walks do the same work. Reports time,
+ * instructions and cache misses per node. The hardware counters are read
+ * with perf_event_open(2) and are reported as "n/a" if not available.
+ */
+
+#include "backend.h"
+#include "flat_ast.h"
+#include "frontend.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+
+using namespace arabilis;
+
+class Counter {
+public:
+    explicit Counter(std::uint64_t config) noexcept {
+        perf_event_attr attr {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = static_cast<int>(
+            syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    Counter(const Counter&) noexcept = delete;
+    Counter& operator=(const Counter&) noexcept = delete;
+
+    Counter(Counter&&) noexcept = delete;
+    Counter& operator=(Counter&&) noexcept = delete;
+
+    ~Counter() noexcept {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    void start() noexcept {
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    /* Events since `start()`, or -1 if the counter is not available. */
+    long long stop() noexcept {
+        long long count = -1;
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+                count = -1;
+            }
+        }
+        return count;
+    }
+
+private:
+    int m_fd;
+};
+
+/* Sums up numerals, symbols and string lengths, through virtual dispatch. */
+class TreeWalk: public Visitor {
+public:
+    void operator()(const AddressOfExpression* node) override {
+        m_sum += node->m_variable_name;
+    }
+
+    void operator()(const BinOpExpression* node) override {
+        m_sum += static_cast<int>(node->m_token);
+        node->m_lhs->visit(*this);
+        node->m_rhs->visit(*this);
+    }
+
+    void operator()(const BreakStatement*) override {
+        m_sum += 1;
+    }
+
+    void operator()(const CallExpression* node) override {
+        m_sum += node->m_variable_name;
+        for (const auto& argument : node->m_arguments) {
+            argument->visit(*this);
+        }
+    }
+
+    void operator()(const ContinueStatement*) override {
+        m_sum += 2;
+    }
+
+    void operator()(const ExpressionStatement* node) override {
+        node->m_expression->visit(*this);
+    }
+
+    void operator()(const ForStatement* node) override {
+        m_sum += node->m_variable_name;
+        node->m_initial->visit(*this);
+        node->m_condition->visit(*this);
+        node->m_update->visit(*this);
+        for (const auto& statement : node->m_statements) {
+            statement->visit(*this);
+        }
+    }
+
+    void operator()(const Function* node) override {
+        m_sum += node->m_name + node->m_arguments.size();
+        for (const auto& statement : node->m_statements) {
+            statement->visit(*this);
+        }
+    }
+
+    void operator()(const GlobalVar* node) override {
+        m_sum += node->m_name;
+        node->m_value->visit(*this);
+    }
+
+    void operator()(const IfStatement* node) override {
+        node->m_condition->visit(*this);
+        for (const auto& statement : node->m_then_statements) {
+            statement->visit(*this);
+        }
+        for (const auto& statement : node->m_else_statements) {
+            statement->visit(*this);
+        }
+    }
+
+    void operator()(const LetStatement* node) override {
+        m_sum += node->m_variable_name;
+        node->m_expression->visit(*this);
+    }
+
+    void operator()(const NumeralExpression* node) override {
+        m_sum += node->m_value;
+    }
+
+    void operator()(const Program* node) override {
+        for (const auto& globalvar : node->m_globalvars) {
+            globalvar.visit(*this);
+        }
+        for (const auto& function : node->m_functions) {
+            function.visit(*this);
+        }
+    }
+
+    void operator()(const ReturnStatement* node) override {
+        node->m_expression->visit(*this);
+    }
+
+    void operator()(const StringExpression* node) override {
+        m_sum += node->m_value.size();
+    }
+
+    void operator()(const UnOpExpression* node) override {
+        m_sum += static_cast<int>(node->m_token);
+        node->m_rhs->visit(*this);
+    }
+
+    void operator()(const VariableExpression* node) override {
+        m_sum += node->m_variable_name;
+    }
+
+    void operator()(const VarStatement* node) override {
+        m_sum += node->m_variable_name;
+        node->m_expression->visit(*this);
+    }
+
+    void operator()(const WhileStatement* node) override {
+        node->m_condition->visit(*this);
+        for (const auto& statement : node->m_statements) {
+            statement->visit(*this);
+        }
+    }
+
+    std::uint64_t m_sum { 0 };
+};
+
+/* The same walk as `TreeWalk`, as a switch over the flat AST. */
+class FlatWalk {
+public:
+    explicit FlatWalk(const FlatAst& ast) noexcept : m_ast { ast } {
+    }
+
+    void visit_program() noexcept {
+        for (const NodeIndex globalvar : m_ast.globalvars()) {
+            visit(globalvar);
+        }
+        for (const NodeIndex function : m_ast.functions()) {
+            visit(function);
+        }
+    }
+
+    void visit(NodeIndex node) noexcept {
+        switch (m_ast.kind(node)) {
+        case NodeKind::address_of:
+        case NodeKind::variable:
+            m_sum += m_ast.symbol(node, 0);
+            break;
+        case NodeKind::bin_op:
+            m_sum += static_cast<int>(m_ast.token(node));
+            visit(m_ast.child(node, 0));
+            visit(m_ast.child(node, 1));
+            break;
+        case NodeKind::break_statement:
+            m_sum += 1;
+            break;
+        case NodeKind::call:
+            m_sum += m_ast.symbol(node, 0);
+            visit_list(m_ast.list(node, 1));
+            break;
+        case NodeKind::continue_statement:
+            m_sum += 2;
+            break;
+        case NodeKind::expression_statement:
+        case NodeKind::return_statement:
+            visit(m_ast.child(node, 0));
+            break;
+        case NodeKind::for_statement:
+            m_sum += m_ast.symbol(node, 0);
+            visit_list(m_ast.list(node, 1));
+            visit_list(m_ast.list(node, 2));
+            break;
+        case NodeKind::function:
+            m_sum += m_ast.symbol(node, 0) + m_ast.list(node, 1).size();
+            visit_list(m_ast.list(node, 2));
+            break;
+        case NodeKind::global_var:
+        case NodeKind::let_statement:
+        case NodeKind::var_statement:
+            m_sum += m_ast.symbol(node, 0);
+            visit(m_ast.child(node, 1));
+            break;
+        case NodeKind::if_statement:
+            visit(m_ast.child(node, 0));
+            visit_list(m_ast.list(node, 1));
+            visit_list(m_ast.list(node, 2));
+            break;
+        case NodeKind::numeral:
+            m_sum += m_ast.value(node);
+            break;
+        case NodeKind::string:
+            m_sum += m_ast.string(node, 0).size();
+            break;
+        case NodeKind::un_op:
+            m_sum += static_cast<int>(m_ast.token(node));
+            visit(m_ast.child(node, 0));
+            break;
+        case NodeKind::while_statement:
+            visit(m_ast.child(node, 0));
+            visit_list(m_ast.list(node, 1));
+            break;
+        }
+    }
+
+    std::uint64_t m_sum { 0 };
+
+private:
+    const FlatAst& m_ast;
+
+    void visit_list(const FlatList& list) noexcept {
+        for (const NodeIndex node : list) {
+            visit(node);
+        }
+    }
+};
+
+/* Random program with nested expressions and control flow. */
+std::string make_program(int functions) {
+    std::mt19937 random { 42 };
+    const char* const operators[] = {
+        "+", "-", "*", "&", "|", "^", "==", "<", "&&"
+    };
+
+    std::string text { "var g = 1;\n" };
+
+    const auto expression = [&](auto& self, int depth) -> std::string {
+        const int choice = static_cast<int>(random() % 10);
+        if (depth > 3 || choice < 3) {
+            return (choice % 2 == 0)
+                ? std::to_string(random() % 100)
+                : std::string { "v" } + std::to_string(random() % 4);
+        }
+        if (choice < 8) {
+            return "(" + self(self, depth + 1) + " " +
+                operators[random() % 9] + " " + self(self, depth + 1) + ")";
+        }
+        return "-(" + self(self, depth + 1) + ")";
+    };
+
+    for (int f = 0; f < functions; ++f) {
+        text += "function f" + std::to_string(f) + "(a, b) {\n";
+        for (int v = 0; v < 4; ++v) {
+            text += "var v" + std::to_string(v) + " = " +
+                expression(expression, 0) + ";\n";
+        }
+        text += "while (" + expression(expression, 0) + ") { let v0 = " +
+            expression(expression, 0) + "; if (v1) { break; } }\n";
+        text += "for (var i = 0; i < 10; let i = i + 1) { let v2 = " +
+            expression(expression, 0) + "; }\n";
+        text += "return f" + std::to_string(f) + "(a, " +
+            expression(expression, 0) + ");\n}\n";
+    }
+    text += "function main() { return 0; }\n";
+
+    return text;
+}
+
+template <typename Function>
+void measure(const char* name, std::size_t nodes, Function function) {
+    constexpr int rounds = 10;
+
+    Counter instructions { PERF_COUNT_HW_INSTRUCTIONS };
+    Counter cache_misses { PERF_COUNT_HW_CACHE_MISSES };
+
+    std::uint64_t sum = 0;
+    const auto begin = std::chrono::steady_clock::now();
+    instructions.start();
+    cache_misses.start();
+
+    for (int round = 0; round < rounds; ++round) {
+        sum += function();
+    }
+
+    const long long misses = cache_misses.stop();
+    const long long instructions_count = instructions.stop();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+
+    const double per_node = 1.0 / (static_cast<double>(nodes) * rounds);
+
+    std::cout
+        << name
+        << elapsed.count() * 1e9 * per_node << " ns/node, ";
+
+    if (instructions_count < 0) {
+        std::cout << "n/a instructions/node, ";
+    } else {
+        std::cout << instructions_count * per_node << " instructions/node, ";
+    }
+
+    if (misses < 0) {
+        std::cout << "n/a cache misses/node";
+    } else {
+        std::cout << misses * per_node << " cache misses/node";
+    }
+
+    std::cout << " (checksum " << sum << ")\n";
+}
+
+} /* namespace */
+
+int main() {
+    const std::string text = make_program(100000);
+
+    std::FILE* file = std::tmpfile();
+    if (file == nullptr ||
+            std::fwrite(text.data(), 1, text.size(), file) != text.size() ||
+            std::fflush(file) != 0) {
+        std::cerr << "Error: Unable to write temporary file\n";
+        return 1;
+    }
+
+    Reader reader { "generated", fileno(file) };
+    std::fclose(file);
+
+    Diagnostics diagnostics { reader.filename(), 0 };
+    Lexer lexer { reader, diagnostics };
+    const TokenArray tokens = lexer.read_all();
+    Parser parser { tokens, diagnostics };
+    const Program program = parser.read();
+    const FlatAst ast = flatten(program);
+
+    std::cout << "nodes: " << ast.size() << '\n';
+
+    measure("pointer AST, visitor: ", ast.size(), [&program]() {
+        TreeWalk walk {};
+        program.visit(walk);
+        return walk.m_sum;
+    });
+
+    measure("flat AST, switch:     ", ast.size(), [&ast]() {
+        FlatWalk walk { ast };
+        walk.visit_program();
+        return walk.m_sum;
+    });
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+/*
+ * Micro-benchmark for keyword recognition. Classifies an identifier-heavy
+ * token stream once with the chain of string compares the lexer used to
+ * run, and once with the keyword table, and reports identifiers per second.
+ */
+
+#include "frontend.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static arabilis::Token keyword_or_identifier_linear(const std::string& s) {
+    using arabilis::Token;
+
+    if (s == "break") {
+        return Token::string_break;
+    }
+    if (s == "continue") {
+        return Token::string_continue;
+    }
+    if (s == "else") {
+        return Token::string_else;
+    }
+    if (s == "false") {
+        return Token::string_false;
+    }
+    if (s == "for") {
+        return Token::string_for;
+    }
+    if (s == "function") {
+        return Token::string_function;
+    }
+    if (s == "if") {
+        return Token::string_if;
+    }
+    if (s == "let") {
+        return Token::string_let;
+    }
+    if (s == "return") {
+        return Token::string_return;
+    }
+    if (s == "true") {
+        return Token::string_true;
+    }
+    if (s == "var") {
+        return Token::string_var;
+    }
+    if (s == "while") {
+        return Token::string_while;
+    }
+
+    return Token::identifier;
+}
+
+/* Mix of keywords, near-keywords and typical generated identifiers. */
+static std::vector<std::string> make_identifiers(std::size_t count) {
+    const char* const words[] = {
+        "var", "let", "if", "while", "return", "function", "for", "true",
+        "i", "x", "value", "result", "whilst", "iffy", "letter", "variable",
+        "tmp_0", "node_count", "buffer_ptr", "falsehood", "elsewhere",
+        "printnum", "putchar", "syscall", "read8", "breakpoint", "fortune",
+    };
+
+    std::mt19937 random { 42 };
+    std::uniform_int_distribution<std::size_t> pick {
+        0, sizeof(words) / sizeof(*words) - 1 };
+
+    std::vector<std::string> identifiers {};
+    identifiers.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        identifiers.emplace_back(words[pick(random)]);
+    }
+
+    return identifiers;
+}
+
+template <typename Function>
+static double identifiers_per_second(
+        const std::vector<std::string>& identifiers,
+        int rounds,
+        Function function) {
+
+    std::size_t keywords = 0;
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        for (const auto& identifier : identifiers) {
+            if (function(identifier) != arabilis::Token::identifier) {
+                keywords += 1;
+            }
+        }
+    }
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+
+    /* keep the result alive, so that the loop is not optimized away */
+    if (keywords == 0) {
+        std::cerr << "Error: No keywords found\n";
+    }
+
+    return identifiers.size() * static_cast<double>(rounds) / elapsed.count();
+}
+
+int main() {
+    const std::vector<std::string> identifiers = make_identifiers(1 << 20);
+    constexpr int rounds = 20;
+
+    const double linear = identifiers_per_second(
+        identifiers,
+        rounds,
+        keyword_or_identifier_linear);
+
+    const double table = identifiers_per_second(
+        identifiers,
+        rounds,
+        [](const std::string& s) {
+            return arabilis::keyword_or_identifier(s);
+        });
+
+    std::cout
+        << "string compares: " << linear / 1e6 << " M identifiers/s\n"
+        << "keyword table:   " << table / 1e6 << " M identifiers/s\n"
+        << "speedup:         " << table / linear << "x\n";
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "branches.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace arabilis {
+
+/* 32 bit form of a short branch, see `is_short_branch`. */
+static Opcode widened(Opcode opcode) noexcept {
+    return static_cast<Opcode>(static_cast<int>(opcode) + 1);
+}
+
+/* Number of bytes an item takes up in the executable. */
+static std::uint32_t size(const Instruction& item) noexcept {
+    switch (item.m_opcode) {
+    case Opcode::label:
+    case Opcode::text:
+        return 0;
+    case Opcode::data:
+        return item.m_size;
+    default: {
+        unsigned char bytes[max_instruction_size];
+        return static_cast<std::uint32_t>(encode(item, 0, bytes) - bytes);
+    }
+    }
+}
+
+/*
+ * Offsets of the end of each item and of each label, relative to the start
+ * of the code.
+ */
+static void layout(
+        const std::vector<Instruction>& items,
+        std::vector<std::uint32_t>& ends,
+        std::vector<std::optional<std::uint32_t>>& labels) noexcept {
+
+    std::uint32_t location { 0 };
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        if (items[i].m_opcode == Opcode::label) {
+            if (labels.size() <= items[i].m_value) {
+                labels.resize(items[i].m_value + 1);
+            }
+            labels[items[i].m_value] = location;
+        }
+
+        location += size(items[i]);
+        ends[i] = location;
+    }
+}
+
+/* Displacement from the end of a branch to its target. */
+static std::int32_t displacement(
+        const Instruction& branch,
+        std::uint32_t end,
+        const std::vector<std::optional<std::uint32_t>>& labels) noexcept {
+
+    const std::uint32_t target = resolve_label(labels, branch.m_value);
+    return static_cast<std::int32_t>(target - end);
+}
+
+void relax_branches(Code& code) noexcept {
+    std::vector<Instruction>& items = code.items();
+
+    std::vector<std::size_t> branches {};
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        if (is_relative_branch(items[i].m_opcode)) {
+            branches.push_back(i);
+        }
+    }
+
+    std::vector<std::uint32_t> ends(items.size(), 0);
+    std::vector<std::optional<std::uint32_t>> labels {};
+
+    /* branches only ever grow, so this ends */
+    for (bool changed = true; changed;) {
+        layout(items, ends, labels);
+
+        changed = false;
+        for (const std::size_t i : branches) {
+            if (!is_short_branch(items[i].m_opcode)) {
+                continue;
+            }
+
+            const std::int32_t distance =
+                displacement(items[i], ends[i], labels);
+            if (distance < -128 || distance > 127) {
+                items[i].m_opcode = widened(items[i].m_opcode);
+                changed = true;
+            }
+        }
+    }
+
+    for (const std::size_t i : branches) {
+        const std::int32_t distance = displacement(items[i], ends[i], labels);
+        items[i].m_operand = Operand::immediate;
+        items[i].m_value = static_cast<std::uint32_t>(distance);
+    }
+}
+
+} /* namespace arabilis */
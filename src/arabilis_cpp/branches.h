@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef BRANCHES_H_
+#define BRANCHES_H_
+
+#include "ir.h"
+
+namespace arabilis {
+
+/*
+ * Choose the encoding of the relative branches in `code`, see
+ * `is_short_branch`, and replace their labels with displacements. A branch
+ * keeps the 8 bit form if its target is in reach, else it is widened to 32
+ * bits. Widening moves other code, so this repeats until no branch changes.
+ *
+ * Must run after all passes that change the code.
+ */
+void relax_branches(Code& code) noexcept;
+
+} /* namespace arabilis */
+
+#endif /* BRANCHES_H_ */
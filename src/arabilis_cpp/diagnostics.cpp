@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "diagnostics.h"
+
+#include <cstdlib>
+#include <iostream>
+
+namespace arabilis {
+
+void Diagnostics::error(
+        const Position& position,
+        std::string_view message) noexcept {
+
+    std::cerr
+        << m_filename
+        << ':'
+        << position
+        << ": Error: "
+        << message
+        << '\n';
+    count();
+}
+
+void Diagnostics::error(std::string_view message) noexcept {
+    std::cerr << m_filename << ": Error: " << message << '\n';
+    count();
+}
+
+void Diagnostics::exit_on_errors() const noexcept {
+    if (m_error_count != 0) {
+        std::exit(1);
+    }
+}
+
+void Diagnostics::count() noexcept {
+    m_error_count += 1;
+    if (m_error_count != m_limit) {
+        return;
+    }
+
+    std::cerr << m_filename << ": Error: Too many errors, stopping\n";
+    std::exit(1);
+}
+
+} /* namespace arabilis */
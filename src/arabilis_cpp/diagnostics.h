@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef DIAGNOSTICS_H_
+#define DIAGNOSTICS_H_
+
+#include "io.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace arabilis {
+
+/*
+ * Sink for the errors in one input file. Errors are printed as they are
+ * reported, so that passes can go on and find more. Once `limit` errors
+ * were reported, compilation stops. A limit of 0 means no limit.
+ */
+class Diagnostics {
+public:
+    explicit Diagnostics(std::string filename, std::size_t limit) noexcept :
+            m_filename { std::move(filename) },
+            m_limit { limit } {
+    }
+
+    Diagnostics(const Diagnostics&) noexcept = delete;
+    Diagnostics& operator=(const Diagnostics&) noexcept = delete;
+
+    Diagnostics(Diagnostics&&) noexcept = default;
+    Diagnostics& operator=(Diagnostics&&) noexcept = default;
+
+    ~Diagnostics() noexcept = default;
+
+    [[nodiscard]] std::size_t error_count() const noexcept {
+        return m_error_count;
+    }
+
+    /* Report an error at `position`. */
+    void error(const Position& position, std::string_view message) noexcept;
+
+    /* Report an error concerning the whole file. */
+    void error(std::string_view message) noexcept;
+
+    /* Exit unsuccessfully if any error was reported. */
+    void exit_on_errors() const noexcept;
+
+private:
+    std::string m_filename;
+    std::size_t m_limit;
+    std::size_t m_error_count { 0 };
+
+    /** Count an error, stop if there are too many. */
+    void count() noexcept;
+};
+
+} /* namespace arabilis */
+
+#endif /* DIAGNOSTICS_H_ */
@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "elf.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace arabilis {
+
+/* Address the file is loaded to, see `label2hex`. */
+static constexpr std::uint32_t head = 0x08048000;
+
+const char hex_elf_header[] =
+        "                            # Elf32_Ehdr: 0x08048000\n"
+        "7F 45 4C 46 01 01 01 00     #     e_ident[0:7]\n"
+        "00 00 00 00 00 00 00 00     #     e_ident[8:15]\n"
+        "02 00                       #     e_type\n"
+        "03 00                       #     e_machine\n"
+        "01 00 00 00                 #     e_version\n"
+        "54 80 04 08                 #     e_entry\n"
+        "34 00 00 00                 #     e_phoff\n"
+        "00 00 00 00                 #     e_shoff\n"
+        "00 00 00 00                 #     e_flags\n"
+        "34 00                       #     e_ehsize\n"
+        "20 00                       #     e_phentsize\n"
+        "01 00                       #     e_phnum\n"
+        "28 00                       #     e_shentsize\n"
+        "00 00                       #     e_shnum\n"
+        "00 00                       #     e_shstrndx\n"
+        "\n"
+        "                            #   Elf32_Phdr: 0x08048034\n"
+        "01 00 00 00                 #       p_type\n"
+        "00 00 00 00                 #       p_offset\n"
+        "00 80 04 08                 #       p_vaddr\n"
+        "00 80 04 08                 #       p_paddr\n"
+        "size                        #       p_filesz\n"
+        "size                        #       p_memsz\n"
+        "07 00 00 00                 #       p_flags\n"
+        "00 00 00 00                 #       p_align\n"
+        "                            #   _start: 0x08048054\n";
+
+/*
+ * The bytes of `hex_elf_header`. The offsets of its "size" fields are
+ * appended to `sizes`, their bytes are left zero.
+ */
+static std::vector<unsigned char> parse_header(
+        std::vector<std::size_t>& sizes) noexcept {
+    std::vector<unsigned char> bytes {};
+    std::string_view text { hex_elf_header };
+    while (!text.empty()) {
+        std::string_view line = text.substr(0, text.find('\n'));
+        text.remove_prefix(std::min(line.size() + 1, text.size()));
+        line = line.substr(0, line.find('#'));
+
+        while (!line.empty()) {
+            if (line.front() == ' ') {
+                line.remove_prefix(1);
+            } else if (line.substr(0, 4) == "size") {
+                sizes.push_back(bytes.size());
+                bytes.resize(bytes.size() + 4);
+                line.remove_prefix(4);
+            } else {
+                const std::string digits { line.substr(0, 2) };
+                bytes.push_back(std::stoul(digits, nullptr, 16));
+                line.remove_prefix(2);
+            }
+        }
+    }
+    return bytes;
+}
+
+/* Little endian, as label2hex writes "size". */
+static void store_u32(unsigned char* out, std::uint32_t value) noexcept {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = 0xff & (value >> (8 * i));
+    }
+}
+
+void write_elf(const Code& code, Writer& writer) noexcept {
+    std::vector<std::size_t> sizes {};
+    std::vector<unsigned char> header = parse_header(sizes);
+
+    /* assign addresses to labels */
+    std::vector<std::optional<std::uint32_t>> addresses {};
+    std::uint32_t location = header.size();
+    for (const Instruction& item : code.items()) {
+        switch (item.m_opcode) {
+        case Opcode::label:
+            if (addresses.size() <= item.m_value) {
+                addresses.resize(item.m_value + 1);
+            }
+            addresses[item.m_value] = head + location;
+            break;
+        case Opcode::data:
+            location += item.m_size;
+            break;
+        case Opcode::text:
+            break;
+        default: {
+            unsigned char bytes[max_instruction_size];
+            location += encode(item, 0, bytes) - bytes;
+            break;
+        }
+        }
+    }
+
+    /* fail on undefined labels before anything is written */
+    for (const Instruction& item : code.items()) {
+        if (is_instruction(item.m_opcode) &&
+                item.m_operand == Operand::label) {
+            resolve_label(addresses, item.m_value);
+        }
+    }
+
+    for (std::size_t offset : sizes) {
+        store_u32(header.data() + offset, location);
+    }
+    writer.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    for (const Instruction& item : code.items()) {
+        switch (item.m_opcode) {
+        case Opcode::label:
+        case Opcode::text:
+            break;
+        case Opcode::data:
+            writer << code.pooled(item);
+            break;
+        default: {
+            std::uint32_t operand = item.m_value;
+            if (item.m_operand == Operand::label) {
+                operand = resolve_label(addresses, item.m_value);
+            }
+
+            unsigned char bytes[max_instruction_size];
+            const unsigned char* end = encode(item, operand, bytes);
+            writer.write(
+                reinterpret_cast<const char*>(bytes),
+                static_cast<std::size_t>(end - bytes));
+            break;
+        }
+        }
+    }
+}
+
+} /* namespace arabilis */
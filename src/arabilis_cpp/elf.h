@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef ELF_H_
+#define ELF_H_
+
+#include "io.h"
+#include "ir.h"
+
+namespace arabilis {
+
+/*
+ * Elf32_Ehdr and Elf32_Phdr in the notation of `label2hex`, the start of the
+ * compiler header. "size" stands for the size of the file.
+ */
+extern const char hex_elf_header[];
+
+/*
+ * Encode code as a 32 bit x86 Linux executable, the same file that
+ * `macro2label`, `label2hex` and `hex2bin` build from the output of `print`.
+ * Instructions are encoded as the macros of the compiler header define them
+ * and labels are resolved in memory. Text items are not part of the
+ * executable, the ELF header comes first in their place.
+ */
+void write_elf(const Code&, Writer&) noexcept;
+
+} /* namespace arabilis */
+
+#endif /* ELF_H_ */
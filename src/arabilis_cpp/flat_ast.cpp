@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "flat_ast.h"
+
+#include "backend.h"
+
+namespace arabilis {
+
+class Flattener: public Visitor {
+public:
+    explicit Flattener(FlatAst& ast) noexcept : m_ast { ast } {
+    }
+
+    Flattener(const Flattener&) noexcept = delete;
+    Flattener& operator=(const Flattener&) noexcept = delete;
+
+    Flattener(Flattener&&) noexcept = default;
+    Flattener& operator=(Flattener&&) noexcept = delete;
+
+    ~Flattener() noexcept override = default;
+
+    void operator()(const AddressOfExpression*) override;
+    void operator()(const BinOpExpression*) override;
+    void operator()(const BreakStatement*) override;
+    void operator()(const CallExpression*) override;
+    void operator()(const ContinueStatement*) override;
+    void operator()(const ExpressionStatement*) override;
+    void operator()(const ForStatement*) override;
+    void operator()(const Function*) override;
+    void operator()(const GlobalVar*) override;
+    void operator()(const IfStatement*) override;
+    void operator()(const LetStatement*) override;
+    void operator()(const NumeralExpression*) override;
+    void operator()(const Program*) override;
+    void operator()(const ReturnStatement*) override;
+    void operator()(const StringExpression*) override;
+    void operator()(const UnOpExpression*) override;
+    void operator()(const VariableExpression*) override;
+    void operator()(const VarStatement*) override;
+    void operator()(const WhileStatement*) override;
+
+private:
+    FlatAst& m_ast;
+
+    /* Index of the node flattened last. */
+    NodeIndex m_result { 0 };
+
+    /** Flatten a subtree, return the index of its root. */
+    NodeIndex flatten(const AST*) noexcept;
+
+    /** Flatten subtrees and append the list of their roots. */
+    template<typename T>
+    std::uint32_t add_nodes(const std::pmr::vector<T*>& nodes) noexcept {
+        std::vector<std::uint32_t> indices {};
+        indices.reserve(nodes.size());
+        for (const auto& node : nodes) {
+            indices.push_back(flatten(node));
+        }
+        return m_ast.add_list(indices);
+    }
+};
+
+FlatAst flatten(const Program& program) noexcept {
+    FlatAst ast { program.m_filename, *program.m_symbols };
+    Flattener flattener { ast };
+    program.visit(flattener);
+    return ast;
+}
+
+NodeIndex FlatAst::add(
+        NodeKind kind,
+        const Position& position,
+        Token token) noexcept {
+
+    m_nodes.push_back({ kind, token, { 0, 0, 0 } });
+    m_positions.push_back(position);
+    return static_cast<NodeIndex>(m_nodes.size() - 1);
+}
+
+void FlatAst::set(NodeIndex node, int slot, std::uint32_t value) noexcept {
+    m_nodes[node].m_operands[slot] = value;
+}
+
+std::uint32_t FlatAst::add_string(std::string_view string) noexcept {
+    m_strings.push_back(string);
+    return static_cast<std::uint32_t>(m_strings.size() - 1);
+}
+
+std::uint32_t FlatAst::add_list(
+        const std::vector<std::uint32_t>& elements) noexcept {
+
+    const auto index = static_cast<std::uint32_t>(m_extra.size());
+    m_extra.push_back(static_cast<std::uint32_t>(elements.size()));
+    m_extra.insert(m_extra.end(), elements.begin(), elements.end());
+    return index;
+}
+
+NodeIndex Flattener::flatten(const AST* node) noexcept {
+    node->visit(*this);
+    return m_result;
+}
+
+void Flattener::operator()(const AddressOfExpression* node) {
+    m_result = m_ast.add(NodeKind::address_of, node->m_position);
+    m_ast.set(m_result, 0, node->m_variable_name);
+}
+
+void Flattener::operator()(const BinOpExpression* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::bin_op, node->m_position, node->m_token);
+    m_ast.set(index, 0, flatten(node->m_lhs));
+    m_ast.set(index, 1, flatten(node->m_rhs));
+    m_result = index;
+}
+
+void Flattener::operator()(const BreakStatement* node) {
+    m_result = m_ast.add(NodeKind::break_statement, node->m_position);
+}
+
+void Flattener::operator()(const CallExpression* node) {
+    const NodeIndex index = m_ast.add(NodeKind::call, node->m_position);
+    m_ast.set(index, 0, node->m_variable_name);
+    m_ast.set(index, 1, add_nodes(node->m_arguments));
+    m_result = index;
+}
+
+void Flattener::operator()(const ContinueStatement* node) {
+    m_result = m_ast.add(NodeKind::continue_statement, node->m_position);
+}
+
+void Flattener::operator()(const ExpressionStatement* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::expression_statement, node->m_position);
+    m_ast.set(index, 0, flatten(node->m_expression));
+    m_result = index;
+}
+
+void Flattener::operator()(const ForStatement* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::for_statement, node->m_position);
+    m_ast.set(index, 0, node->m_variable_name);
+
+    const NodeIndex initial = flatten(node->m_initial);
+    const NodeIndex condition = flatten(node->m_condition);
+    const NodeIndex update = flatten(node->m_update);
+    m_ast.set(index, 1, m_ast.add_list({ initial, condition, update }));
+
+    m_ast.set(index, 2, add_nodes(node->m_statements));
+    m_result = index;
+}
+
+void Flattener::operator()(const Function* node) {
+    const NodeIndex index = m_ast.add(NodeKind::function, node->m_position);
+    m_ast.set(index, 0, node->m_name);
+
+    const std::vector<std::uint32_t> arguments {
+        node->m_arguments.begin(),
+        node->m_arguments.end()
+    };
+    m_ast.set(index, 1, m_ast.add_list(arguments));
+
+    m_ast.set(index, 2, add_nodes(node->m_statements));
+    m_result = index;
+}
+
+void Flattener::operator()(const GlobalVar* node) {
+    const NodeIndex index = m_ast.add(NodeKind::global_var, node->m_position);
+    m_ast.set(index, 0, node->m_name);
+    m_ast.set(index, 1, flatten(node->m_value));
+    m_result = index;
+}
+
+void Flattener::operator()(const IfStatement* node) {
+    const NodeIndex index = m_ast.add(NodeKind::if_statement, node->m_position);
+    m_ast.set(index, 0, flatten(node->m_condition));
+    m_ast.set(index, 1, add_nodes(node->m_then_statements));
+    m_ast.set(index, 2, add_nodes(node->m_else_statements));
+    m_result = index;
+}
+
+void Flattener::operator()(const LetStatement* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::let_statement, node->m_position);
+    m_ast.set(index, 0, node->m_variable_name);
+    m_ast.set(index, 1, flatten(node->m_expression));
+    m_result = index;
+}
+
+void Flattener::operator()(const NumeralExpression* node) {
+    m_result = m_ast.add(NodeKind::numeral, node->m_position);
+    m_ast.set(m_result, 0, static_cast<std::uint32_t>(node->m_value));
+}
+
+void Flattener::operator()(const Program* node) {
+    for (const auto& globalvar : node->m_globalvars) {
+        m_ast.m_globalvars.push_back(flatten(&globalvar));
+    }
+
+    for (const auto& function : node->m_functions) {
+        m_ast.m_functions.push_back(flatten(&function));
+    }
+}
+
+void Flattener::operator()(const ReturnStatement* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::return_statement, node->m_position);
+    m_ast.set(index, 0, flatten(node->m_expression));
+    m_result = index;
+}
+
+void Flattener::operator()(const StringExpression* node) {
+    m_result = m_ast.add(NodeKind::string, node->m_position);
+    m_ast.set(m_result, 0, m_ast.add_string(node->m_value));
+}
+
+void Flattener::operator()(const UnOpExpression* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::un_op, node->m_position, node->m_token);
+    m_ast.set(index, 0, flatten(node->m_rhs));
+    m_result = index;
+}
+
+void Flattener::operator()(const VariableExpression* node) {
+    m_result = m_ast.add(NodeKind::variable, node->m_position);
+    m_ast.set(m_result, 0, node->m_variable_name);
+}
+
+void Flattener::operator()(const VarStatement* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::var_statement, node->m_position);
+    m_ast.set(index, 0, node->m_variable_name);
+    m_ast.set(index, 1, flatten(node->m_expression));
+    m_result = index;
+}
+
+void Flattener::operator()(const WhileStatement* node) {
+    const NodeIndex index =
+        m_ast.add(NodeKind::while_statement, node->m_position);
+    m_ast.set(index, 0, flatten(node->m_condition));
+    m_ast.set(index, 1, add_nodes(node->m_statements));
+    m_result = index;
+}
+
+} /* namespace arabilis */
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef FLAT_AST_H_
+#define FLAT_AST_H_
+
+#include "ast.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace arabilis {
+
+/*
+ * Compact form of a `Program` for the passes that only read it. Nodes are
+ * stored in one array in pre-order and refer to each other by 32-bit index.
+ * Each node has up to three operands, whose meaning depends on its kind:
+ *
+ *   global_var             name, value
+ *   function               name, arguments (list of symbols), statements
+ *   break_statement        -
+ *   continue_statement     -
+ *   expression_statement   expression
+ *   for_statement          name, [initial, condition, update], statements
+ *   if_statement           condition, then statements, else statements
+ *   let_statement          name, expression
+ *   return_statement       expression
+ *   var_statement          name, expression
+ *   while_statement        condition, statements
+ *   address_of             name
+ *   bin_op                 lhs, rhs
+ *   call                   name, arguments
+ *   numeral                value
+ *   string                 value
+ *   un_op                  rhs
+ *   variable               name
+ *
+ * Names are symbols, string values are indices into the string table.
+ * Lists are indices into the extra array, which holds the element count
+ * followed by the elements. Positions are kept apart, as they are only
+ * needed for error messages.
+ */
+enum class NodeKind : std::uint8_t {
+    global_var,
+    function,
+    break_statement,
+    continue_statement,
+    expression_statement,
+    for_statement,
+    if_statement,
+    let_statement,
+    return_statement,
+    var_statement,
+    while_statement,
+    address_of,
+    bin_op,
+    call,
+    numeral,
+    string,
+    un_op,
+    variable
+};
+
+/* Whether nodes of `kind` are expressions, which come last in `NodeKind`. */
+[[nodiscard]] constexpr bool is_expression(NodeKind kind) noexcept {
+    return kind >= NodeKind::address_of;
+}
+
+using NodeIndex = std::uint32_t;
+
+struct FlatNode {
+    NodeKind m_kind;
+    Token m_token;
+    std::uint32_t m_operands[3];
+};
+
+static_assert(sizeof(FlatNode) == 16, "FlatNode should stay compact");
+
+/* Range of node indices or symbols, see `FlatAst::list`. */
+class FlatList {
+public:
+    FlatList(const std::uint32_t* begin, const std::uint32_t* end) noexcept :
+            m_begin { begin },
+            m_end { end } {
+    }
+
+    [[nodiscard]] const std::uint32_t* begin() const noexcept {
+        return m_begin;
+    }
+
+    [[nodiscard]] const std::uint32_t* end() const noexcept {
+        return m_end;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return m_end - m_begin;
+    }
+
+    [[nodiscard]] std::uint32_t operator[](std::size_t index) const noexcept {
+        return m_begin[index];
+    }
+
+private:
+    const std::uint32_t* m_begin;
+    const std::uint32_t* m_end;
+};
+
+class FlatAst {
+public:
+    explicit FlatAst(
+            std::string_view filename,
+            const SymbolTable& symbols) noexcept :
+                    m_filename { filename },
+                    m_symbols { &symbols } {
+    }
+
+    FlatAst(const FlatAst&) noexcept = delete;
+    FlatAst& operator=(const FlatAst&) noexcept = delete;
+
+    FlatAst(FlatAst&&) noexcept = default;
+    FlatAst& operator=(FlatAst&&) noexcept = default;
+
+    ~FlatAst() noexcept = default;
+
+    [[nodiscard]] std::string_view filename() const noexcept {
+        return m_filename;
+    }
+
+    [[nodiscard]] const SymbolTable& symbols() const noexcept {
+        return *m_symbols;
+    }
+
+    [[nodiscard]] std::string_view name(Symbol symbol) const noexcept {
+        return m_symbols->name(symbol);
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return m_nodes.size();
+    }
+
+    [[nodiscard]] NodeKind kind(NodeIndex node) const noexcept {
+        return m_nodes[node].m_kind;
+    }
+
+    [[nodiscard]] Token token(NodeIndex node) const noexcept {
+        return m_nodes[node].m_token;
+    }
+
+    [[nodiscard]] const Position& position(NodeIndex node) const noexcept {
+        return m_positions[node];
+    }
+
+    [[nodiscard]] NodeIndex child(NodeIndex node, int slot) const noexcept {
+        return m_nodes[node].m_operands[slot];
+    }
+
+    [[nodiscard]] Symbol symbol(NodeIndex node, int slot) const noexcept {
+        return m_nodes[node].m_operands[slot];
+    }
+
+    [[nodiscard]] std::string_view string(
+            NodeIndex node,
+            int slot) const noexcept {
+        return m_strings[m_nodes[node].m_operands[slot]];
+    }
+
+    [[nodiscard]] int value(NodeIndex node) const noexcept {
+        return static_cast<int>(m_nodes[node].m_operands[0]);
+    }
+
+    [[nodiscard]] FlatList list(NodeIndex node, int slot) const noexcept {
+        const std::uint32_t* begin =
+            m_extra.data() + m_nodes[node].m_operands[slot];
+        return { begin + 1, begin + 1 + *begin };
+    }
+
+    /* Top level declarations, in order of appearance. */
+    [[nodiscard]] const std::vector<NodeIndex>& globalvars() const noexcept {
+        return m_globalvars;
+    }
+
+    [[nodiscard]] const std::vector<NodeIndex>& functions() const noexcept {
+        return m_functions;
+    }
+
+private:
+    friend class Flattener;
+    friend class ConstantFolder;
+    friend class Inliner;
+
+    /** Append a node without operands, return its index. */
+    NodeIndex add(NodeKind, const Position&, Token = Token::eof) noexcept;
+
+    /** Set an operand of an appended node. */
+    void set(NodeIndex, int slot, std::uint32_t) noexcept;
+
+    /** Append to the string table, return the index. */
+    std::uint32_t add_string(std::string_view) noexcept;
+
+    /** Append a list of node indices to the extra array. */
+    std::uint32_t add_list(const std::vector<std::uint32_t>&) noexcept;
+
+    std::string_view m_filename;
+    const SymbolTable* m_symbols;
+    std::vector<FlatNode> m_nodes {};
+    std::vector<Position> m_positions {};
+    std::vector<std::uint32_t> m_extra {};
+    std::vector<std::string_view> m_strings {};
+    std::vector<NodeIndex> m_globalvars {};
+    std::vector<NodeIndex> m_functions {};
+};
+
+/* Flatten `program`, which must outlive the result. */
+[[nodiscard]] FlatAst flatten(const Program& program) noexcept;
+
+} /* namespace arabilis */
+
+#endif /* FLAT_AST_H_ */
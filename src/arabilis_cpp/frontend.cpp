@@ -3,260 +3,385 @@
 
 #include "frontend.h"
 
+#include "lexer_table.h"
+#include "scan.h"
+
+#include <array>
 #include <iostream>
 
 namespace arabilis {
 
-static constexpr bool is_whitespace(int c) {
-    return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+static constexpr int valueof_hex(int c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 10;
+    }
+    return c - 'A' + 10;
 }
 
-static constexpr bool is_alpha(int c) {
-    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
-}
+/*
+ * Keywords are told apart by length and first character alone. The table
+ * is built from the `Token::string_*` enumerators at compile time, and
+ * building it fails if two keywords ever end up in the same slot.
+ */
+static constexpr std::size_t keyword_slots = 32;
 
-static constexpr bool is_numeral(int c) {
-    return c >= '0' && c <= '9';
+static constexpr std::size_t keyword_hash(std::string_view name) noexcept {
+    return (name.size() + 3 * static_cast<unsigned char>(name[0])) %
+        keyword_slots;
 }
 
-static constexpr bool is_id_begin(int c) {
-    return is_alpha(c) || c == '_';
-}
+struct KeywordTable {
+    std::array<Token, keyword_slots> m_tokens {};
+    std::array<std::string_view, keyword_slots> m_names {};
+};
+
+static constexpr KeywordTable make_keyword_table() {
+    KeywordTable table {};
+
+    for (auto& token : table.m_tokens) {
+        token = Token::identifier;
+    }
+
+    const auto first = static_cast<int>(Token::string_break);
+    const auto last = static_cast<int>(Token::string_while);
+    for (int i = first; i <= last; ++i) {
+        const Token token = static_cast<Token>(i);
+        const std::string_view name = token_to_name(token);
+        const std::size_t slot = keyword_hash(name);
 
-static constexpr bool is_id_trail(int c) {
-    return is_id_begin(c) || is_numeral(c);
+        if (table.m_tokens[slot] != Token::identifier) {
+            throw "keyword hash collision";
+        }
+
+        table.m_tokens[slot] = token;
+        table.m_names[slot] = name;
+    }
+
+    return table;
 }
 
-static constexpr bool is_hex(int c) {
-    return is_numeral(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+static constexpr KeywordTable keyword_table = make_keyword_table();
+
+Token keyword_or_identifier(std::string_view identifier) noexcept {
+    const std::size_t slot = keyword_hash(identifier);
+
+    if (keyword_table.m_names[slot] == identifier) {
+        return keyword_table.m_tokens[slot];
+    }
+
+    return Token::identifier;
 }
 
-static constexpr int valueof_hex(int c) {
-    if (c >= '0' && c <= '9') {
-        return c - '0';
+namespace table = lexer_table;
+
+using Scan = const char* (*)(const char*, const char*) noexcept;
+
+/* What the driver needs to know about a state of the transition table. */
+struct LexerState {
+    Token m_token { Token::eof };
+    bool m_accepting { false };
+    bool m_hidden { false };
+    Scan m_scan { nullptr };
+};
+
+/* Token for a rule name or literal accepted by the transition table. */
+static constexpr Token token_for_rule(std::string_view name) {
+    if (name == "IDENTIFIER") {
+        return Token::identifier;
     }
-    if (c >= 'a' && c <= 'z') {
-        return c - 'a' + 10;
+    if (name == "INT") {
+        return Token::numeral;
+    }
+    if (name == "STRING") {
+        return Token::literal;
     }
-    return c - 'A' + 10;
-}
 
-Lexer::Lexer(Reader& reader) noexcept :
-        m_reader { reader },
-        m_char { reader.read() } {
+    const auto first = static_cast<int>(Token::bracket_round_left);
+    const auto last = static_cast<int>(Token::token_assign);
+    for (int i = first; i <= last; ++i) {
+        if (name == token_to_name(static_cast<Token>(i))) {
+            return static_cast<Token>(i);
+        }
+    }
+
+    throw "grammar token without matching enumerator";
 }
 
-Token Lexer::read() noexcept {
-    while (is_whitespace(m_char) || m_char == '#') {
-        /* discard whitespace */
-        while (is_whitespace(m_char)) {
-            m_position = m_reader.position();
-            m_char = m_reader.read();
+/* Whether `state` loops on exactly the bytes `predicate` accepts. */
+template<typename Predicate>
+static constexpr bool loops_on(int state, Predicate predicate) {
+    for (int c = 0; c < 256; ++c) {
+        const bool loops =
+            table::transitions[state][table::byte_class[c]] == state;
+        if (loops != predicate(c)) {
+            return false;
         }
+    }
+    return true;
+}
 
-        /* discard comments */
-        if (m_char == '#') {
-            m_position = m_reader.position();
-            while (m_char != -1 && m_char != '\n') {
-                m_position = m_reader.position();
-                m_char = m_reader.read();
+/*
+ * States that loop on a run of bytes one of the scanning kernels handles
+ * skip that run in one go, e.g. within whitespace, comments and identifiers.
+ */
+static constexpr std::array<LexerState, table::state_count> make_states() {
+    std::array<LexerState, table::state_count> states {};
+
+    for (int i = 0; i < table::state_count; ++i) {
+        LexerState& state = states[i];
+
+        if (table::accepts[i] != nullptr) {
+            state.m_accepting = true;
+            state.m_hidden = table::hidden[i];
+            if (!state.m_hidden) {
+                state.m_token = token_for_rule(table::accepts[i]);
             }
         }
-    }
 
-    /* end of file */
-    if (m_char == -1) {
-        return Token::eof;
+        if (loops_on(i, [](int c) {
+                return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+            })) {
+            state.m_scan = scan_whitespace;
+        } else if (loops_on(i, [](int c) {
+                return c != '\n';
+            })) {
+            state.m_scan = scan_line;
+        } else if (loops_on(i, [](int c) {
+                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    (c >= '0' && c <= '9') || c == '_';
+            })) {
+            state.m_scan = scan_id_trail;
+        } else if (loops_on(i, [](int c) {
+                return c >= '0' && c <= '9';
+            })) {
+            state.m_scan = scan_numeral;
+        }
     }
 
-    /* identifier or keyword */
-    if (is_id_begin(m_char)) {
-        m_data.clear();
-        while (is_id_trail(m_char)) {
-            m_data += static_cast<char>(m_char);
-            m_char = m_reader.read();
-        }
+    return states;
+}
+
+static constexpr std::array<LexerState, table::state_count> lexer_states =
+    make_states();
 
-        if (m_data == "break") {
-            return Token::string_break;
+/* Decode the escape sequences in the body of an accepted literal. */
+static void decode_literal(std::string& literal, std::string_view text) {
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\\') {
+            literal += text[i];
+            continue;
         }
-        if (m_data == "continue") {
-            return Token::string_continue;
+
+        i += 1;
+        switch (text[i]) {
+        case 'n':
+            literal += '\n';
+            break;
+        case 'r':
+            literal += '\r';
+            break;
+        case 't':
+            literal += '\t';
+            break;
+        case 'x':
+            literal += static_cast<char>(
+                16 * valueof_hex(text[i + 1]) + valueof_hex(text[i + 2]));
+            i += 2;
+            break;
+        default:
+            literal += text[i];
+            break;
         }
-        if (m_data == "else") {
-            return Token::string_else;
+    }
+}
+
+Lexer::Lexer(Reader& reader, Diagnostics& diagnostics) noexcept :
+        m_reader { reader },
+        m_diagnostics { diagnostics },
+        m_begin { reader.data().data() },
+        m_cursor { m_begin },
+        m_end { m_begin + reader.data().size() } {
+}
+
+Token Lexer::read() noexcept {
+    for (;;) {
+        m_offset = m_cursor - m_begin;
+
+        /* end of file */
+        if (m_cursor == m_end) {
+            return Token::eof;
         }
-        if (m_data == "false") {
-            return Token::string_false;
+
+        /* longest match: run until rejected, remember last accepting state */
+        int state = table::state_start;
+        int accepted = table::state_reject;
+        const char* accepted_end = m_cursor;
+        const char* cursor = m_cursor;
+
+        while (cursor != m_end) {
+            const auto c = static_cast<unsigned char>(*cursor);
+            state = table::transitions[state][table::byte_class[c]];
+            if (state == table::state_reject) {
+                break;
+            }
+
+            cursor += 1;
+            if (lexer_states[state].m_scan != nullptr) {
+                cursor = lexer_states[state].m_scan(cursor, m_end);
+            }
+
+            if (lexer_states[state].m_accepting) {
+                accepted = state;
+                accepted_end = cursor;
+            }
         }
-        if (m_data == "for") {
-            return Token::string_for;
+
+        if (accepted == table::state_reject) {
+            m_cursor = reject(cursor);
+            continue;
         }
-        if (m_data == "function") {
-            return Token::string_function;
+
+        m_cursor = accepted_end;
+
+        /* discard whitespace and comments */
+        if (lexer_states[accepted].m_hidden) {
+            continue;
         }
-        if (m_data == "if") {
-            return Token::string_if;
+
+        const Token token = lexer_states[accepted].m_token;
+        m_data = { m_begin + m_offset, (m_cursor - m_begin) - m_offset };
+
+        if (token == Token::identifier) {
+            const Token keyword = keyword_or_identifier(m_data);
+            if (keyword == Token::identifier) {
+                m_symbol = m_symbols.intern(m_data);
+            }
+            return keyword;
         }
-        if (m_data == "let") {
-            return Token::string_let;
+
+        if (token == Token::literal) {
+            m_data = m_data.substr(1, m_data.size() - 2);
+
+            /* literals with escape sequences are decoded into the lexer */
+            if (m_data.find('\\') != std::string_view::npos) {
+                std::string& literal = m_literals.emplace_back();
+                decode_literal(literal, m_data);
+                m_data = literal;
+            }
         }
-        if (m_data == "return") {
-            return Token::string_return;
+
+        return token;
+    }
+}
+
+/*
+ * Report why no token could be read, `stop` is where the table rejected.
+ * Returns where to go on: after the broken literal or after the run of
+ * characters that can not start a token.
+ */
+const char* Lexer::reject(const char* stop) noexcept {
+    const char* message = "Unexpected character";
+    const char* resume = stop;
+
+    if (*m_cursor == '"') {
+        if (stop == m_end) {
+            message = "Missing terminating \" character";
+        } else if (stop[-1] == '\\') {
+            message = "Unknown escape sequence";
+        } else {
+            message = "Invalid escape sequence";
         }
-        if (m_data == "true") {
-            return Token::string_true;
+
+        while (resume != m_end && *resume != '"') {
+            if (*resume == '\\' && resume + 1 != m_end) {
+                resume += 1;
+            }
+            resume += 1;
         }
-        if (m_data == "var") {
-            return Token::string_var;
+        if (resume != m_end) {
+            resume += 1;
         }
-        if (m_data == "while") {
-            return Token::string_while;
+    } else {
+        stop = m_cursor;
+        resume = m_cursor + 1;
+        while (resume != m_end) {
+            const auto c = static_cast<unsigned char>(*resume);
+            const int state =
+                table::transitions[table::state_start][table::byte_class[c]];
+            if (state != table::state_reject) {
+                break;
+            }
+            resume += 1;
         }
+    }
 
-        return Token::identifier;
+    m_diagnostics.error(m_reader.position_at(stop - m_begin), message);
+    return resume;
+}
+
+std::string_view TokenArray::data(std::size_t index) const noexcept {
+    if (m_kinds[index] == Token::literal && m_values[index] != no_value) {
+        return m_decoded[m_values[index]];
     }
 
-    /* numeral */
-    if (is_numeral(m_char)) {
-        m_data.clear();
-        while (is_numeral(m_char)) {
-            m_data += static_cast<char>(m_char);
-            m_char = m_reader.read();
-        }
+    std::string_view text = m_reader.data().substr(
+        m_offsets[index],
+        m_lengths[index]);
 
-        return Token::numeral;
+    if (m_kinds[index] == Token::literal) {
+        /* strip quotes */
+        text = text.substr(1, text.size() - 2);
     }
 
-    /* string literal */
-    if (m_char == '"') {
-        m_data.clear();
-
-        m_char = m_reader.read();
-        while (m_char != '\"') {
-            if (m_char == -1) {
-                std::cerr
-                    << m_reader
-                    << ": Error: Missing terminating \" character\n";
-                std::exit(1);
-            } else if (m_char == '\\') {
-                m_char = m_reader.read();
-
-                if (m_char == '\\') {
-                    m_data += '\\';
-                } else if (m_char == '"') {
-                    m_data += '"';
-                } else if (m_char == 'n') {
-                    m_data += '\n';
-                } else if (m_char == 'r') {
-                    m_data += '\r';
-                } else if (m_char == 't') {
-                    m_data += '\t';
-                } else if (m_char == 'x') {
-                    int char1 = m_reader.read();
-                    int char2 = m_reader.read();
-                    if (!is_hex(char1) || !is_hex(char2)) {
-                        std::cerr
-                            << m_reader
-                            << ": Error: Invalid escape sequence\n";
-                        std::exit(1);
-                    }
-                    m_data += static_cast<char>(
-                        16 * valueof_hex(char1) + valueof_hex(char2));
-                } else {
-                    std::cerr
-                        << m_reader
-                        << ": Error: Unknown escape sequence\n";
-                    std::exit(1);
-                }
-            } else {
-                m_data += static_cast<char>(m_char);
-            }
+    return text;
+}
 
-            m_char = m_reader.read();
-        }
+TokenArray Lexer::read_all() noexcept {
+    TokenArray tokens { m_reader };
 
-        m_char = m_reader.read();
-        return Token::literal;
+    if (m_reader.data().size() >= UINT32_MAX) {
+        std::cerr << filename() << ": Error: Input too large\n";
+        std::exit(1);
     }
 
-    const int last_char = m_char;
-    m_char = m_reader.read();
-
-    switch (last_char) {
-    case '{':
-        return Token::bracket_curly_left;
-    case '}':
-        return Token::bracket_curly_right;
-    case '(':
-        return Token::bracket_round_left;
-    case ')':
-        return Token::bracket_round_right;
-    case ',':
-        return Token::token_comma;
-    case ';':
-        return Token::token_semicolon;
-    case '+':
-        return Token::token_plus;
-    case '-':
-        return Token::token_minus;
-    case '*':
-        return Token::token_multiply;
-    case '/':
-        return Token::token_divide;
-    case '%':
-        return Token::token_modulo;
-    case '~':
-        return Token::token_bit_not;
-    case '^':
-        return Token::token_bit_xor;
-    case '&':
-        if (m_char == '&') {
-            m_char = m_reader.read();
-            return Token::token_log_and;
-        }
-        return Token::token_bit_and;
-    case '|':
-        if (m_char == '|') {
-            m_char = m_reader.read();
-            return Token::token_log_or;
-        }
-        return Token::token_bit_or;
-    case '=':
-        if (m_char == '=') {
-            m_char = m_reader.read();
-            return Token::token_equal;
-        }
-        return Token::token_assign;
-    case '!':
-        if (m_char == '=') {
-            m_char = m_reader.read();
-            return Token::token_notequal;
-        }
-        return Token::token_log_not;
-    case '<':
-        if (m_char == '=') {
-            m_char = m_reader.read();
-            return Token::token_lessequal;
+    for (;;) {
+        const std::size_t decoded = m_literals.size();
+        const Token token = read();
+        const std::size_t length = (m_cursor - m_begin) - m_offset;
+
+        tokens.m_kinds.push_back(token);
+        tokens.m_offsets.push_back(static_cast<std::uint32_t>(m_offset));
+        tokens.m_lengths.push_back(static_cast<std::uint32_t>(length));
+
+        std::uint32_t value = TokenArray::no_value;
+        if (token == Token::identifier) {
+            value = m_symbol;
+        } else if (m_literals.size() != decoded) {
+            value = static_cast<std::uint32_t>(decoded);
         }
-        return Token::token_less;
-    case '>':
-        if (m_char == '=') {
-            m_char = m_reader.read();
-            return Token::token_greaterequal;
+        tokens.m_values.push_back(value);
+
+        if (token == Token::eof) {
+            break;
         }
-        return Token::token_greater;
-    default:
-        break;
     }
 
-    std::cerr << m_reader << ": Error: Unexpected character\n";
-    std::exit(1);
+    /* moving keeps the decoded strings in place, `m_data` stays valid */
+    tokens.m_decoded = std::move(m_literals);
+    m_literals.clear();
+    tokens.m_symbols = std::move(m_symbols);
+
+    return tokens;
 }
 
-Parser::Parser(Lexer& lexer) noexcept :
-        m_lexer { lexer },
-        m_token { Token::eof } {
+Parser::Parser(const TokenArray& tokens, Diagnostics& diagnostics) noexcept :
+        m_tokens { tokens },
+        m_diagnostics { diagnostics },
+        m_index { 0 },
+        m_token { tokens.kind(0) } {
 }
 
 bool Parser::accept(Token token) {
@@ -264,7 +389,10 @@ bool Parser::accept(Token token) {
         return false;
     }
 
-    m_token = m_lexer.read();
+    if (m_token != Token::eof) {
+        m_index += 1;
+        m_token = m_tokens.kind(m_index);
+    }
     return true;
 }
 
@@ -273,38 +401,138 @@ void Parser::expect(Token token) {
         return;
     }
 
-    std::cerr
-        << m_lexer.filename()
-        << ':'
-        << m_lexer.position()
-        << ": Error: Unexpected token \""
-        << token_to_name(m_token)
-        << "\" (expected: \""
-        << token_to_name (token)
-        << "\")\n";
-    std::exit(1);
+    /* after recovering, do not report the same token twice */
+    if (m_index != m_error_index) {
+        m_error_index = m_index;
+
+        std::string message { "Unexpected token \"" };
+        message += token_to_name(m_token);
+        message += "\" (expected: \"";
+        message += token_to_name(token);
+        message += "\")";
+        m_diagnostics.error(token_position(), message);
+    }
+
+    throw SyntaxError {};
+}
+
+void Parser::skip_statement() {
+    int depth = 0;
+
+    for (;;) {
+        switch (m_token) {
+        case Token::eof:
+        case Token::string_function:
+            return;
+        case Token::string_if:
+        case Token::string_while:
+        case Token::string_for:
+        case Token::string_var:
+        case Token::string_let:
+        case Token::string_return:
+        case Token::string_continue:
+        case Token::string_break:
+            if (depth == 0) {
+                return;
+            }
+            break;
+        case Token::token_semicolon:
+            if (depth == 0) {
+                accept(m_token);
+                return;
+            }
+            break;
+        case Token::bracket_curly_left:
+            depth += 1;
+            break;
+        case Token::bracket_curly_right:
+            if (depth == 0) {
+                return;
+            }
+
+            depth -= 1;
+            if (depth == 0) {
+                /* skipped a block, which might be followed by "else" */
+                accept(m_token);
+                if (m_token != Token::string_else) {
+                    return;
+                }
+                continue;
+            }
+            break;
+        default:
+            break;
+        }
+
+        accept(m_token);
+    }
+}
+
+void Parser::skip_declaration() {
+    int depth = 0;
+
+    for (;;) {
+        switch (m_token) {
+        case Token::eof:
+            return;
+        case Token::string_function:
+        case Token::string_var:
+            if (depth == 0) {
+                return;
+            }
+            break;
+        case Token::bracket_curly_left:
+            depth += 1;
+            break;
+        case Token::bracket_curly_right:
+            if (depth > 0) {
+                depth -= 1;
+            }
+            break;
+        default:
+            break;
+        }
+
+        accept(m_token);
+    }
+}
+
+void Parser::parse_statements(std::pmr::vector<Statement*>& statements) {
+    while (m_token != Token::bracket_curly_right &&
+            m_token != Token::string_function &&
+            m_token != Token::eof) {
+        try {
+            statements.push_back(parse_statement());
+        } catch (const SyntaxError&) {
+            skip_statement();
+        }
+    }
 }
 
 Program Parser::read() {
-    Program program { m_lexer.filename() };
-    m_token = m_lexer.read();
+    Program program { m_tokens.filename(), m_tokens.symbols() };
+    m_arena = program.arena();
 
     while (true) {
-        if (m_token == Token::string_function) {
-            program.m_functions.push_back(parse_function());
-        } else if (m_token == Token::string_var) {
-            program.m_globalvars.push_back(parse_globalvar());
-        } else {
-            break;
+        try {
+            if (m_token == Token::string_function) {
+                program.m_functions.push_back(parse_function());
+            } else if (m_token == Token::string_var) {
+                program.m_globalvars.push_back(parse_globalvar());
+            } else {
+                expect(Token::eof);
+                break;
+            }
+        } catch (const SyntaxError&) {
+            skip_declaration();
         }
     }
 
-    expect(Token::eof);
     return program;
 }
 
 Function Parser::parse_function() {
-    Function function { m_lexer.position() };
+    Function function { token_position(), m_arena };
 
     expect(Token::string_function);
 
@@ -326,9 +554,7 @@ Function Parser::parse_function() {
 
     expect(Token::bracket_curly_left);
 
-    while (m_token != Token::bracket_curly_right) {
-        function.m_statements.push_back(parse_statement());
-    }
+    parse_statements(function.m_statements);
 
     expect(Token::bracket_curly_right);
 
@@ -336,7 +562,7 @@ Function Parser::parse_function() {
 }
 
 GlobalVar Parser::parse_globalvar() {
-    GlobalVar globalvar { m_lexer.position() };
+    GlobalVar globalvar { token_position() };
 
     expect(Token::string_var);
 
@@ -344,23 +570,23 @@ GlobalVar Parser::parse_globalvar() {
 
     expect(Token::token_assign);
 
-    const Position position = m_lexer.position();
+    const Position position = token_position();
     if (m_token == Token::literal) {
         globalvar.m_value =
-            std::make_unique<StringExpression>(position, parse_literal());
+            make<StringExpression>(position, parse_literal());
     } else if (m_token == Token::string_true) {
         expect(Token::string_true);
-        globalvar.m_value = std::make_unique<NumeralExpression>(position, 1);
+        globalvar.m_value = make<NumeralExpression>(position, 1);
     } else if (m_token == Token::string_false) {
         expect(Token::string_false);
-        globalvar.m_value = std::make_unique<NumeralExpression>(position, 0);
+        globalvar.m_value = make<NumeralExpression>(position, 0);
     } else if (m_token == Token::token_minus) {
         expect(Token::token_minus);
         globalvar.m_value =
-            std::make_unique<NumeralExpression>(position, -parse_numeral());
+            make<NumeralExpression>(position, -parse_numeral());
     } else {
         globalvar.m_value =
-            std::make_unique<NumeralExpression>(position, parse_numeral());
+            make<NumeralExpression>(position, parse_numeral());
     }
 
     expect(Token::token_semicolon);
@@ -369,7 +595,7 @@ GlobalVar Parser::parse_globalvar() {
 }
 
 ExpressionStatement Parser::parse_statement_expression() {
-    ExpressionStatement statement { m_lexer.position() };
+    ExpressionStatement statement { token_position() };
 
     statement.m_expression = parse_expression();
 
@@ -379,7 +605,7 @@ ExpressionStatement Parser::parse_statement_expression() {
 }
 
 IfStatement Parser::parse_statement_if() {
-    IfStatement statement { m_lexer.position() };
+    IfStatement statement { token_position(), m_arena };
 
     expect(Token::string_if);
 
@@ -391,9 +617,7 @@ IfStatement Parser::parse_statement_if() {
 
     expect(Token::bracket_curly_left);
 
-    while (m_token != Token::bracket_curly_right) {
-        statement.m_then_statements.push_back(parse_statement());
-    }
+    parse_statements(statement.m_then_statements);
 
     expect(Token::bracket_curly_right);
 
@@ -402,9 +626,7 @@ IfStatement Parser::parse_statement_if() {
 
         expect(Token::bracket_curly_left);
 
-        while (m_token != Token::bracket_curly_right) {
-            statement.m_else_statements.push_back(parse_statement());
-        }
+        parse_statements(statement.m_else_statements);
 
         expect(Token::bracket_curly_right);
     }
@@ -413,7 +635,7 @@ IfStatement Parser::parse_statement_if() {
 }
 
 WhileStatement Parser::parse_statement_while() {
-    WhileStatement statement { m_lexer.position() };
+    WhileStatement statement { token_position(), m_arena };
 
     expect(Token::string_while);
 
@@ -425,9 +647,7 @@ WhileStatement Parser::parse_statement_while() {
 
     expect(Token::bracket_curly_left);
 
-    while (m_token != Token::bracket_curly_right) {
-        statement.m_statements.push_back(parse_statement());
-    }
+    parse_statements(statement.m_statements);
 
     expect(Token::bracket_curly_right);
 
@@ -435,7 +655,7 @@ WhileStatement Parser::parse_statement_while() {
 }
 
 ForStatement Parser::parse_statement_for() {
-    ForStatement statement { m_lexer.position() };
+    ForStatement statement { token_position(), m_arena };
 
     expect(Token::string_for);
 
@@ -457,14 +677,12 @@ ForStatement Parser::parse_statement_for() {
 
     expect(Token::string_let);
 
-    std::string identifier = parse_identifier();
+    const Position position = token_position();
+    const Symbol identifier = parse_identifier();
     if (identifier != statement.m_variable_name) {
-        std::cerr
-            << m_lexer.filename()
-            << ':'
-            << m_lexer.position()
-            << ": Error: Variable name does not match in \"for\" statement\n";
-        std::exit(1);
+        m_diagnostics.error(
+            position,
+            "Variable name does not match in \"for\" statement");
     }
 
     expect(Token::token_assign);
@@ -475,9 +693,7 @@ ForStatement Parser::parse_statement_for() {
 
     expect(Token::bracket_curly_left);
 
-    while (m_token != Token::bracket_curly_right) {
-        statement.m_statements.push_back(parse_statement());
-    }
+    parse_statements(statement.m_statements);
 
     expect(Token::bracket_curly_right);
 
@@ -485,7 +701,7 @@ ForStatement Parser::parse_statement_for() {
 }
 
 VarStatement Parser::parse_statement_var() {
-    VarStatement statement { m_lexer.position() };
+    VarStatement statement { token_position() };
 
     expect(Token::string_var);
 
@@ -497,7 +713,7 @@ VarStatement Parser::parse_statement_var() {
         statement.m_expression = parse_expression();
     } else {
         statement.m_expression =
-            std::make_unique<NumeralExpression>(m_lexer.position(), 0);
+            make<NumeralExpression>(token_position(), 0);
     }
 
     expect(Token::token_semicolon);
@@ -506,7 +722,7 @@ VarStatement Parser::parse_statement_var() {
 }
 
 LetStatement Parser::parse_statement_let() {
-    LetStatement statement { m_lexer.position() };
+    LetStatement statement { token_position() };
 
     expect(Token::string_let);
 
@@ -522,7 +738,7 @@ LetStatement Parser::parse_statement_let() {
 }
 
 ReturnStatement Parser::parse_statement_return() {
-    ReturnStatement statement { m_lexer.position() };
+    ReturnStatement statement { token_position() };
 
     expect(Token::string_return);
 
@@ -530,7 +746,7 @@ ReturnStatement Parser::parse_statement_return() {
         statement.m_expression = parse_expression();
     } else {
         statement.m_expression =
-            std::make_unique<NumeralExpression>(m_lexer.position(), 0);
+            make<NumeralExpression>(token_position(), 0);
     }
 
     expect(Token::token_semicolon);
@@ -539,7 +755,7 @@ ReturnStatement Parser::parse_statement_return() {
 }
 
 ContinueStatement Parser::parse_statement_continue() {
-    ContinueStatement statement { m_lexer.position() };
+    ContinueStatement statement { token_position() };
 
     expect(Token::string_continue);
 
@@ -549,7 +765,7 @@ ContinueStatement Parser::parse_statement_continue() {
 }
 
 BreakStatement Parser::parse_statement_break() {
-    BreakStatement statement { m_lexer.position() };
+    BreakStatement statement { token_position() };
 
     expect(Token::string_break);
 
@@ -558,35 +774,35 @@ BreakStatement Parser::parse_statement_break() {
     return statement;
 }
 
-std::unique_ptr<Statement> Parser::parse_statement() {
+Statement* Parser::parse_statement() {
     switch (m_token) {
     case Token::string_if:
-        return std::make_unique<IfStatement>(parse_statement_if());
+        return make<IfStatement>(parse_statement_if());
     case Token::string_while:
-        return std::make_unique<WhileStatement>(parse_statement_while());
+        return make<WhileStatement>(parse_statement_while());
     case Token::string_for:
-        return std::make_unique<ForStatement>(parse_statement_for());
+        return make<ForStatement>(parse_statement_for());
     case Token::string_var:
-        return std::make_unique<VarStatement>(parse_statement_var());
+        return make<VarStatement>(parse_statement_var());
     case Token::string_let:
-        return std::make_unique<LetStatement>(parse_statement_let());
+        return make<LetStatement>(parse_statement_let());
     case Token::string_return:
-        return std::make_unique<ReturnStatement>(parse_statement_return());
+        return make<ReturnStatement>(parse_statement_return());
     case Token::string_continue:
-        return std::make_unique<ContinueStatement>(parse_statement_continue());
+        return make<ContinueStatement>(parse_statement_continue());
     case Token::string_break:
-        return std::make_unique<BreakStatement>(parse_statement_break());
+        return make<BreakStatement>(parse_statement_break());
     default:
         break;
     }
 
-    return std::make_unique<ExpressionStatement>(parse_statement_expression());
+    return make<ExpressionStatement>(parse_statement_expression());
 }
 
-std::unique_ptr<Expression> Parser::parse_expression() {
-    Position position = m_lexer.position();
+Expression* Parser::parse_expression() {
+    Position position = token_position();
 
-    std::unique_ptr<Expression> lhs = parse_term();
+    Expression* lhs = parse_term();
     if (m_token == Token::token_plus || m_token == Token::token_minus ||
         m_token == Token::token_multiply || m_token == Token::token_divide ||
         m_token == Token::token_modulo || m_token == Token::token_log_and ||
@@ -599,40 +815,40 @@ std::unique_ptr<Expression> Parser::parse_expression() {
         const Token token = m_token;
         expect(token);
 
-        return std::make_unique<BinOpExpression>(
-            position, token, std::move(lhs), parse_term());
+        return make<BinOpExpression>(
+            position, token, lhs, parse_term());
     }
 
     return lhs;
 }
 
-std::unique_ptr<Expression> Parser::parse_term() {
-    Position position = m_lexer.position();
+Expression* Parser::parse_term() {
+    Position position = token_position();
 
     if (m_token == Token::token_plus || m_token == Token::token_minus ||
         m_token == Token::token_log_not || m_token == Token::token_bit_not) {
         const Token token = m_token;
         expect(token);
 
-        return std::make_unique<UnOpExpression>(
+        return make<UnOpExpression>(
             position, token, parse_factor());
     }
 
     return parse_factor();
 }
 
-std::unique_ptr<Expression> Parser::parse_factor() {
-    const Position position = m_lexer.position();
+Expression* Parser::parse_factor() {
+    const Position position = token_position();
 
     if (m_token == Token::identifier) {
-        std::string identifier = parse_identifier();
+        const Symbol identifier = parse_identifier();
 
         if (m_token != Token::bracket_round_left) {
-            return std::make_unique<VariableExpression>(position, identifier);
+            return make<VariableExpression>(position, identifier);
         }
 
         auto expression =
-            std::make_unique<CallExpression>(position, identifier);
+            make<CallExpression>(position, identifier, m_arena);
 
         expect(Token::bracket_round_left);
 
@@ -654,41 +870,41 @@ std::unique_ptr<Expression> Parser::parse_factor() {
     if (m_token == Token::token_bit_and) {
         expect(m_token);
 
-        return std::make_unique<AddressOfExpression>(
+        return make<AddressOfExpression>(
             position, parse_identifier());
     }
 
     if (m_token == Token::string_true) {
         expect(m_token);
 
-        return std::make_unique<NumeralExpression>(position, 1);
+        return make<NumeralExpression>(position, 1);
     }
 
     if (m_token == Token::string_false) {
         expect(m_token);
 
-        return std::make_unique<NumeralExpression>(position, 0);
+        return make<NumeralExpression>(position, 0);
     }
 
     if (m_token == Token::literal) {
-        return std::make_unique<StringExpression>(position, parse_literal());
+        return make<StringExpression>(position, parse_literal());
     }
 
     if (m_token == Token::bracket_round_left) {
         expect(Token::bracket_round_left);
 
-        std::unique_ptr<Expression> expression = parse_expression();
+        Expression* expression = parse_expression();
 
         expect(Token::bracket_round_right);
 
         return expression;
     }
 
-    return std::make_unique<NumeralExpression>(position, parse_numeral());
+    return make<NumeralExpression>(position, parse_numeral());
 }
 
-std::string Parser::parse_identifier() {
-    std::string identifier = m_lexer.data();
+Symbol Parser::parse_identifier() {
+    const Symbol identifier = m_tokens.symbol(m_index);
 
     expect(Token::identifier);
 
@@ -698,7 +914,7 @@ std::string Parser::parse_identifier() {
 int Parser::parse_numeral() {
     int numeral = 0;
 
-    for (const char c : m_lexer.data()) {
+    for (const char c : m_tokens.data(m_index)) {
         numeral = numeral * 10 + c - '0';
     }
 
@@ -707,8 +923,8 @@ int Parser::parse_numeral() {
     return numeral;
 }
 
-std::string Parser::parse_literal() {
-    std::string literal = m_lexer.data();
+std::string_view Parser::parse_literal() {
+    const std::string_view literal = m_tokens.data(m_index);
 
     expect(Token::literal);
 
@@ -5,13 +5,88 @@
 #define FRONTEND_H_
 
 #include "ast.h"
+#include "diagnostics.h"
 #include "io.h"
+#include "symbols.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace arabilis {
 
+/* Keyword token for non-empty `identifier`, or `Token::identifier`. */
+[[nodiscard]] Token keyword_or_identifier(std::string_view identifier) noexcept;
+
+/*
+ * All tokens of an input, as structure of arrays. Offset and length give
+ * the extent of each token in the input. Identifiers additionally carry
+ * their symbol, literals with escape sequences refer to their decoded value
+ * by index.
+ */
+class TokenArray {
+public:
+    static constexpr std::uint32_t no_value = UINT32_MAX;
+
+    explicit TokenArray(const Reader& reader) noexcept : m_reader { reader } {
+    }
+
+    TokenArray(const TokenArray&) noexcept = delete;
+    TokenArray& operator=(const TokenArray&) noexcept = delete;
+
+    TokenArray(TokenArray&&) noexcept = default;
+    TokenArray& operator=(TokenArray&&) noexcept = delete;
+
+    ~TokenArray() noexcept = default;
+
+    [[nodiscard]] const std::string& filename() const noexcept {
+        return m_reader.filename();
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return m_kinds.size();
+    }
+
+    [[nodiscard]] Token kind(std::size_t index) const noexcept {
+        return m_kinds[index];
+    }
+
+    [[nodiscard]] Position position(std::size_t index) const noexcept {
+        return m_reader.position_at(m_offsets[index]);
+    }
+
+    /* Text of an identifier or numeral, or the value of a literal. */
+    [[nodiscard]] std::string_view data(std::size_t index) const noexcept;
+
+    /* Symbol of an identifier. */
+    [[nodiscard]] Symbol symbol(std::size_t index) const noexcept {
+        return m_values[index];
+    }
+
+    [[nodiscard]] const SymbolTable& symbols() const noexcept {
+        return m_symbols;
+    }
+
+private:
+    friend class Lexer;
+
+    const Reader& m_reader;
+    std::vector<Token> m_kinds {};
+    std::vector<std::uint32_t> m_offsets {};
+    std::vector<std::uint32_t> m_lengths {};
+    std::vector<std::uint32_t> m_values {};
+    std::deque<std::string> m_decoded {};
+    SymbolTable m_symbols {};
+};
+
 class Lexer {
 public:
-    explicit Lexer(Reader& reader) noexcept;
+    explicit Lexer(Reader& reader, Diagnostics& diagnostics) noexcept;
 
     Lexer(const Lexer&) noexcept = delete;
     Lexer& operator=(const Lexer&) noexcept = delete;
@@ -25,26 +100,46 @@ public:
         return m_reader.filename();
     }
 
-    [[nodiscard]] const Position& position() const noexcept {
-        return m_position;
+    [[nodiscard]] Position position() const noexcept {
+        return m_reader.position_at(m_offset);
     }
 
-    [[nodiscard]] const std::string& data() const noexcept {
+    /*
+     * Text of the last identifier, numeral or literal. Refers to the input
+     * buffer, or to decoded literals owned by the lexer.
+     */
+    [[nodiscard]] std::string_view data() const noexcept {
         return m_data;
     }
 
+    /* Symbol of the last identifier. */
+    [[nodiscard]] Symbol symbol() const noexcept {
+        return m_symbol;
+    }
+
     [[nodiscard]] Token read() noexcept;
 
+    /* Read all remaining tokens, up to and including `Token::eof`. */
+    [[nodiscard]] TokenArray read_all() noexcept;
+
 private:
     Reader& m_reader;
-    Position m_position {};
-    std::string m_data {};
-    int m_char;
+    Diagnostics& m_diagnostics;
+    const char* m_begin;
+    const char* m_cursor;
+    const char* m_end;
+    std::size_t m_offset { 0 };
+    std::string_view m_data {};
+    std::deque<std::string> m_literals {};
+    SymbolTable m_symbols {};
+    Symbol m_symbol { SymbolTable::no_symbol };
+
+    const char* reject(const char* stop) noexcept;
 };
 
 class Parser {
 public:
-    explicit Parser(Lexer& lexer) noexcept;
+    explicit Parser(const TokenArray& tokens, Diagnostics& diagnostics) noexcept;
 
     Parser(const Parser&) noexcept = delete;
     Parser& operator=(const Parser&) noexcept = delete;
@@ -57,15 +152,45 @@ public:
     Program read();
 
 private:
-    Lexer& m_lexer;
+    const TokenArray& m_tokens;
+    Diagnostics& m_diagnostics;
+    std::size_t m_index;
     Token m_token;
+    std::pmr::memory_resource* m_arena { nullptr };
+
+    /* Index of the token of the last syntax error. */
+    std::size_t m_error_index { SIZE_MAX };
+
+    /* Thrown after reporting a syntax error, caught where parsing resumes. */
+    struct SyntaxError {
+    };
+
+    /* Allocate a node in the arena of the program being read. */
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        void* memory = m_arena->allocate(sizeof(T), alignof(T));
+        return new (memory) T { std::forward<Args>(args)... };
+    }
+
+    [[nodiscard]] Position token_position() const noexcept {
+        return m_tokens.position(m_index);
+    }
 
     bool accept(Token);
     void expect(Token);
 
+    /** Skip tokens up to the start of the next statement. */
+    void skip_statement();
+
+    /** Skip tokens up to the next top level declaration. */
+    void skip_declaration();
+
+    /** Parse statements up to the closing bracket of a block. */
+    void parse_statements(std::pmr::vector<Statement*>&);
+
     int parse_numeral();
-    std::string parse_literal();
-    std::string parse_identifier();
+    std::string_view parse_literal();
+    Symbol parse_identifier();
 
     Function parse_function();
     GlobalVar parse_globalvar();
@@ -78,10 +203,10 @@ private:
     ReturnStatement parse_statement_return();
     ContinueStatement parse_statement_continue();
     BreakStatement parse_statement_break();
-    std::unique_ptr<Expression> parse_term();
-    std::unique_ptr<Expression> parse_factor();
-    std::unique_ptr<Statement> parse_statement();
-    std::unique_ptr<Expression> parse_expression();
+    Expression* parse_term();
+    Expression* parse_factor();
+    Statement* parse_statement();
+    Expression* parse_expression();
 
 };
 
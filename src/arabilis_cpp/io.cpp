@@ -3,48 +3,164 @@
 
 #include "io.h"
 
-#include <istream>
-#include <ostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace arabilis {
 
-void Position::advance() noexcept {
-    m_column += 1;
+int Position::line() const noexcept {
+    if (m_index == nullptr) {
+        return 1;
+    }
+
+    return m_index->line(m_offset);
 }
 
-void Position::advance_to_tabstop() noexcept {
-    while (m_column % 8 != 0) {
-        advance();
+int Position::column() const noexcept {
+    if (m_index == nullptr) {
+        return 0;
     }
-}
 
-void Position::advance_to_newline() noexcept {
-    m_column = 0;
-    m_line += 1;
+    return m_index->column(m_offset);
 }
 
 std::ostream& operator<<(std::ostream& stream, const Position& position) {
     return stream << position.line() << ':' << position.column();
 }
 
-/* Read single byte cast to int or -1 on EOF. */
-int Reader::read() noexcept {
-    m_position.advance();
+int LineIndex::line(std::size_t offset) const noexcept {
+    return static_cast<int>(line_index(offset)) + 1;
+}
 
-    const int c = m_stream.get();
+int LineIndex::column(std::size_t offset) const noexcept {
+    const std::size_t end = std::min(offset, m_data.size());
+    int column = 0;
 
-    if (m_stream.eof()) {
-        return -1;
+    for (auto i = m_line_starts[line_index(offset)]; i < end; ++i) {
+        column += 1;
+
+        if (m_data[i] == '\t') {
+            column = (column + 7) / 8 * 8;
+        }
     }
 
-    if (c == '\t') {
-        m_position.advance_to_tabstop();
+    return column + static_cast<int>(offset - end);
+}
+
+std::size_t LineIndex::line_index(std::size_t offset) const noexcept {
+    if (m_line_starts.empty()) {
+        const char* begin = m_data.data();
+        const char* end = begin + m_data.size();
+
+        m_line_starts.push_back(0);
+        for (const char* it = begin; it != end; ++it) {
+            it = static_cast<const char*>(std::memchr(it, '\n', end - it));
+            if (it == nullptr) {
+                break;
+            }
+            m_line_starts.push_back(it - begin + 1);
+        }
+    }
+
+    const auto it = std::upper_bound(
+        m_line_starts.begin(),
+        m_line_starts.end(),
+        offset);
+
+    return static_cast<std::size_t>(it - m_line_starts.begin()) - 1;
+}
+
+Reader::Reader(std::string filename, int fd) noexcept :
+        m_filename { std::move(filename) } {
+
+    struct stat info {};
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        const auto size = static_cast<std::size_t>(info.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            m_mapping = mapping;
+            m_data = static_cast<const char*>(mapping);
+            m_size = size;
+            m_index = std::make_unique<LineIndex>(data());
+            return;
+        }
     }
 
-    if (c == '\n') {
-        m_position.advance_to_newline();
+    /* not a regular file or mapping failed, read in large blocks instead */
+    constexpr std::size_t block_size = 64 * 1024;
+    for (;;) {
+        const std::size_t used = m_buffer.size();
+        m_buffer.resize(used + block_size);
+
+        const ssize_t count = ::read(fd, m_buffer.data() + used, block_size);
+        if (count < 0 && errno == EINTR) {
+            m_buffer.resize(used);
+            continue;
+        }
+
+        if (count < 0) {
+            std::cerr
+                << "Error: Unable to read input file \""
+                << m_filename
+                << "\"\n";
+            std::exit(1);
+        }
+
+        m_buffer.resize(used + static_cast<std::size_t>(count));
+        if (count == 0) {
+            break;
+        }
+    }
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    m_index = std::make_unique<LineIndex>(data());
+}
+
+Reader::Reader(Reader&& other) noexcept :
+        m_filename { std::move(other.m_filename) },
+        m_buffer { std::move(other.m_buffer) },
+        m_mapping { std::exchange(other.m_mapping, nullptr) },
+        m_data { std::exchange(other.m_data, nullptr) },
+        m_size { std::exchange(other.m_size, 0) },
+        m_offset { std::exchange(other.m_offset, 0) },
+        m_index { std::move(other.m_index) } {
+}
+
+Reader& Reader::operator=(Reader&& other) noexcept {
+    std::swap(m_filename, other.m_filename);
+    std::swap(m_buffer, other.m_buffer);
+    std::swap(m_mapping, other.m_mapping);
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_offset, other.m_offset);
+    std::swap(m_index, other.m_index);
+    return *this;
+}
+
+Reader::~Reader() noexcept {
+    if (m_mapping != nullptr) {
+        munmap(m_mapping, m_size);
+    }
+}
+
+/* Read single byte cast to int or -1 on EOF. */
+int Reader::read() noexcept {
+    if (m_offset == m_size) {
+        return -1;
     }
 
+    const int c = static_cast<unsigned char>(m_data[m_offset]);
+    m_offset += 1;
     return c;
 }
 
@@ -52,4 +168,120 @@ std::ostream& operator<<(std::ostream& stream, const Reader& reader) {
     return stream << reader.filename() << ':' << reader.position() << ':';
 }
 
+/* Size of the output buffer for writers backed by a file descriptor. */
+static constexpr std::size_t writer_buffer_size = 1024 * 1024;
+
+Writer::Writer(int fd) noexcept :
+        m_fd { fd },
+        m_limit { writer_buffer_size } {
+    m_buffer.reserve(writer_buffer_size);
+}
+
+Writer::Writer() noexcept :
+        m_fd { -1 },
+        m_limit { std::string::npos } {
+}
+
+Writer::Writer(Writer&& other) noexcept :
+        m_fd { std::exchange(other.m_fd, -1) },
+        m_limit { other.m_limit },
+        m_buffer { std::move(other.m_buffer) } {
+    other.m_buffer.clear();
+}
+
+Writer& Writer::operator=(Writer&& other) noexcept {
+    flush();
+    m_fd = std::exchange(other.m_fd, -1);
+    m_limit = other.m_limit;
+    m_buffer = std::move(other.m_buffer);
+    other.m_buffer.clear();
+    return *this;
+}
+
+Writer::~Writer() noexcept {
+    flush();
+}
+
+static void write_all(int fd, iovec* iov, int iovcnt) noexcept {
+    while (iovcnt > 0) {
+        ssize_t count = writev(fd, iov, iovcnt);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count < 0) {
+            std::cerr << "Error: Unable to write output\n";
+            std::exit(1);
+        }
+
+        /* skip what has been written, retry the rest */
+        while (iovcnt > 0 && static_cast<std::size_t>(count) >= iov->iov_len) {
+            count -= static_cast<ssize_t>(iov->iov_len);
+            iov += 1;
+            iovcnt -= 1;
+        }
+
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + count;
+            iov->iov_len -= static_cast<std::size_t>(count);
+        }
+    }
+}
+
+void Writer::flush() noexcept {
+    if (m_fd < 0 || m_buffer.empty()) {
+        return;
+    }
+
+    iovec iov[1] = {
+        { m_buffer.data(), m_buffer.size() }
+    };
+    write_all(m_fd, iov, 1);
+    m_buffer.clear();
+}
+
+void Writer::write_through(const char* data, std::size_t size) noexcept {
+    if (size < m_limit) {
+        flush();
+        m_buffer.append(data, size);
+        return;
+    }
+
+    /* too large to be buffered, write both in one go */
+    iovec iov[2] = {
+        { m_buffer.data(), m_buffer.size() },
+        { const_cast<char*>(data), size }
+    };
+    write_all(m_fd, iov, 2);
+    m_buffer.clear();
+}
+
+Writer& operator<<(Writer& writer, int value) noexcept {
+    char digits[16];
+    char* end = digits + sizeof(digits);
+    char* begin = end;
+
+    /* negate as unsigned, so that INT_MIN survives */
+    unsigned int magnitude = static_cast<unsigned int>(value);
+    if (value < 0) {
+        magnitude = 0u - magnitude;
+    }
+
+    do {
+        *--begin = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        *--begin = '-';
+    }
+
+    writer.write(begin, static_cast<std::size_t>(end - begin));
+    return writer;
+}
+
+Writer& operator<<(Writer& writer, const Position& position) noexcept {
+    return writer << position.line() << ':' << position.column();
+}
+
 } /* namespace arabilis */
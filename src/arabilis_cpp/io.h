@@ -4,20 +4,25 @@
 #ifndef IO_H_
 #define IO_H_
 
+#include <cstddef>
 #include <iosfwd>
-#include <utility>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace arabilis {
 
+class LineIndex;
+
 class Position {
 public:
-    Position() noexcept : m_line { 1 }, m_column { 0 } {
-    }
+    Position() noexcept = default;
 
-    Position(int line, int column) noexcept:
-            m_line { line },
-            m_column { column } {
+    Position(const LineIndex* index, std::size_t offset) noexcept:
+            m_index { index },
+            m_offset { offset } {
     }
 
     Position(const Position&) noexcept = default;
@@ -28,48 +33,83 @@ public:
 
     ~Position() noexcept = default;
 
-    [[nodiscard]] int line() const noexcept {
-        return m_line;
+    [[nodiscard]] int line() const noexcept;
+
+    [[nodiscard]] int column() const noexcept;
+
+    [[nodiscard]] std::size_t offset() const noexcept {
+        return m_offset;
     }
 
-    [[nodiscard]] int column() const noexcept {
-        return m_column;
+    friend std::ostream& operator<<(std::ostream&, const Position&);
+
+private:
+    const LineIndex* m_index { nullptr };
+    std::size_t m_offset { 0 };
+};
+
+/*
+ * Maps byte offsets to line and column. The line starts are only searched
+ * for once the first position is actually printed.
+ */
+class LineIndex {
+public:
+    explicit LineIndex(std::string_view data) noexcept : m_data { data } {
     }
 
-    void advance() noexcept;
+    LineIndex(const LineIndex&) noexcept = delete;
+    LineIndex& operator=(const LineIndex&) noexcept = delete;
 
-    void advance_to_tabstop() noexcept;
+    LineIndex(LineIndex&&) noexcept = delete;
+    LineIndex& operator=(LineIndex&&) noexcept = delete;
 
-    void advance_to_newline() noexcept;
+    ~LineIndex() noexcept = default;
 
-    friend std::ostream& operator<<(std::ostream&, const Position&);
+    /* Line number, starting at 1. */
+    [[nodiscard]] int line(std::size_t offset) const noexcept;
+
+    /* Column number, starting at 0. Tabs advance to the next tab stop. */
+    [[nodiscard]] int column(std::size_t offset) const noexcept;
 
 private:
-    int m_line;
-    int m_column;
+    std::string_view m_data;
+    mutable std::vector<std::size_t> m_line_starts {};
+
+    /** Index of the line containing `offset`, starting at 0. */
+    std::size_t line_index(std::size_t offset) const noexcept;
 };
 
 class Reader {
 public:
-    Reader(std::string filename, std::istream& stream) noexcept:
-            m_filename { std::move(filename) },
-            m_stream { stream } {
-    }
+    /*
+     * Map the file behind `fd` into memory. Input that can not be mapped,
+     * e.g. a pipe or a terminal, is read into a buffer instead.
+     */
+    Reader(std::string filename, int fd) noexcept;
 
     Reader(const Reader&) noexcept = delete;
     Reader& operator=(const Reader&) noexcept = delete;
 
-    Reader(Reader&&) noexcept = default;
-    Reader& operator=(Reader&&) noexcept = default;
+    Reader(Reader&&) noexcept;
+    Reader& operator=(Reader&&) noexcept;
 
-    ~Reader() noexcept = default;
+    ~Reader() noexcept;
 
     [[nodiscard]] const std::string& filename() const noexcept {
         return m_filename;
     }
 
-    [[nodiscard]] const Position& position() const noexcept {
-        return m_position;
+    [[nodiscard]] Position position() const noexcept {
+        return position_at(m_offset);
+    }
+
+    [[nodiscard]] Position position_at(std::size_t offset) const noexcept {
+        return { m_index.get(), offset };
+    }
+
+    /* Complete input as one contiguous span of bytes. */
+    [[nodiscard]] std::string_view data() const noexcept {
+        return { m_data, m_size };
     }
 
     /* Read single byte cast to int or -1 on EOF. */
@@ -79,32 +119,75 @@ public:
 
 private:
     std::string m_filename;
-    std::istream& m_stream;
-    Position m_position {};
+    std::vector<char> m_buffer {};
+    void* m_mapping { nullptr };
+    const char* m_data { nullptr };
+    std::size_t m_size { 0 };
+    std::size_t m_offset { 0 };
+    std::unique_ptr<LineIndex> m_index {};
 };
 
 class Writer {
 public:
-    explicit Writer(std::ostream& stream) noexcept:
-        m_stream { stream } {
-    }
+    /* Collect output in a large buffer and write it to `fd` in blocks. */
+    explicit Writer(int fd) noexcept;
+
+    /* Keep the complete output in memory, see `str()`. */
+    Writer() noexcept;
 
     Writer(const Writer&) noexcept = delete;
     Writer& operator=(const Writer&) noexcept = delete;
 
-    Writer(Writer&&) noexcept = default;
-    Writer& operator=(Writer&&) noexcept = default;
+    Writer(Writer&&) noexcept;
+    Writer& operator=(Writer&&) noexcept;
+
+    ~Writer() noexcept;
+
+    /* Output collected so far. Complete output for in-memory writers. */
+    [[nodiscard]] std::string_view str() const noexcept {
+        return m_buffer;
+    }
+
+    void write(const char* data, std::size_t size) noexcept {
+        if (m_buffer.size() + size <= m_limit) {
+            m_buffer.append(data, size);
+            return;
+        }
+
+        write_through(data, size);
+    }
+
+    /* Write buffered output to the file descriptor, if any. */
+    void flush() noexcept;
 
-    ~Writer() noexcept = default;
+    friend Writer& operator<<(Writer& writer, char value) noexcept {
+        writer.write(&value, 1);
+        return writer;
+    }
 
-    template <typename T>
-    friend Writer& operator<<(Writer& writer, const T& value) {
-        writer.m_stream << value;
+    friend Writer& operator<<(Writer& writer, const char* value) noexcept {
+        writer.write(value, std::char_traits<char>::length(value));
         return writer;
     }
 
+    friend Writer& operator<<(
+            Writer& writer,
+            std::string_view value) noexcept {
+        writer.write(value.data(), value.size());
+        return writer;
+    }
+
+    friend Writer& operator<<(Writer&, int) noexcept;
+
+    friend Writer& operator<<(Writer&, const Position&) noexcept;
+
 private:
-    std::ostream& m_stream;
+    int m_fd;
+    std::size_t m_limit;
+    std::string m_buffer {};
+
+    /* Flush buffer and `data` with as few system calls as possible. */
+    void write_through(const char* data, std::size_t size) noexcept;
 };
 
 } /* namespace arabilis */
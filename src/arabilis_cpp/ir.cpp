@@ -0,0 +1,467 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "ir.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+
+namespace arabilis {
+
+/* Macro names by opcode, see `Opcode`. */
+static const char* const formats[] = {
+    "add_R_S",
+    "add_R_imm",
+    "and_R_S",
+    "call_ref_R",
+    "call_rel32",
+    "cdq",
+    "cmp_R_S",
+    "cmp_R_imm",
+    "hop_ne",
+    "idiv_R",
+    "idiv_ref_esp",
+    "imul_R_S",
+    "int_80",
+    "je_rel8",
+    "je_rel32",
+    "jg_rel8",
+    "jg_rel32",
+    "jge_rel8",
+    "jge_rel32",
+    "jl_rel8",
+    "jl_rel32",
+    "jle_rel8",
+    "jle_rel32",
+    "jmp_R",
+    "jmp_rel8",
+    "jmp_rel32",
+    "jne_rel8",
+    "jne_rel32",
+    "mov_R_S",
+    "mov_R_imm",
+    "mov_R_ref_S",
+    "mov_R_ref_ebp_imm",
+    "mov_ref_R_S",
+    "movzx_R_B",
+    "neg_R",
+    "not_R",
+    "or_R_S",
+    "pop_R",
+    "push_R",
+    "push_imm",
+    "ret",
+    "sete_B",
+    "setg_B",
+    "setge_B",
+    "setl_B",
+    "setle_B",
+    "setne_B",
+    "sub_R_S",
+    "sub_R_imm",
+    "xchg_R_S",
+    "xor_R_S"
+};
+
+static_assert(
+    std::size(formats) == static_cast<std::size_t>(Opcode::label),
+    "one format per instruction");
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+const char* name(Register reg) noexcept {
+    static const char* const names[] = {
+        "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"
+    };
+    return names[static_cast<int>(reg)];
+}
+
+const char* byte_name(Register reg) noexcept {
+    static const char* const names[] = { "al", "cl", "dl", "bl" };
+    return names[static_cast<int>(reg)];
+}
+
+static char* append(char* out, const char* text) noexcept {
+    while (*text != '\0') {
+        *out++ = *text++;
+    }
+    return out;
+}
+
+static char* append_byte(char* out, unsigned char byte) noexcept {
+    *out++ = hex_digits[byte >> 4];
+    *out++ = hex_digits[byte & 0x0f];
+    return out;
+}
+
+/* Immediates are little endian, e.g. 1 is "01000000". */
+static char* append_immediate(
+        char* out,
+        std::uint32_t value,
+        bool bytes) noexcept {
+
+    for (int i = 0; i < 4; ++i) {
+        if (bytes && i > 0) {
+            *out++ = ' ';
+        }
+        out = append_byte(out, 0xff & (value >> (8 * i)));
+    }
+    return out;
+}
+
+static char* append_label(char* out, std::uint32_t id) noexcept {
+    const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    char reversed[8];
+    int count = 0;
+    while (id > 0) {
+        reversed[count++] = digits[id % 36];
+        id /= 36;
+    }
+
+    while (count < 3) {
+        reversed[count++] = '0';
+    }
+
+    *out++ = 'l';
+    while (count > 0) {
+        *out++ = reversed[--count];
+    }
+    return out;
+}
+
+static void print_instruction(
+        const Instruction& instruction,
+        Writer& writer) noexcept {
+
+    char line[64];
+    char* out = line;
+
+    const char* format = formats[static_cast<int>(instruction.m_opcode)];
+    for (; *format != '\0'; ++format) {
+        switch (*format) {
+        case 'R':
+            out = append(out, name(instruction.m_r));
+            break;
+        case 'S':
+            out = append(out, name(instruction.m_s));
+            break;
+        case 'B':
+            out = append(out, byte_name(instruction.m_r));
+            break;
+        default:
+            *out++ = *format;
+            break;
+        }
+    }
+
+    switch (instruction.m_operand) {
+    case Operand::none:
+        break;
+    case Operand::immediate:
+    case Operand::immediate_bytes:
+        *out++ = ' ';
+        if (is_short_branch(instruction.m_opcode)) {
+            out = append_byte(out, 0xff & instruction.m_value);
+            break;
+        }
+        out = append_immediate(
+            out,
+            instruction.m_value,
+            instruction.m_operand == Operand::immediate_bytes);
+        break;
+    case Operand::label:
+        *out++ = ' ';
+        out = append_label(out, instruction.m_value);
+        break;
+    }
+
+    *out++ = '\n';
+    writer.write(line, static_cast<std::size_t>(out - line));
+}
+
+static void print_data(std::string_view bytes, Writer& writer) noexcept {
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        char hex[3];
+        append_byte(hex, static_cast<unsigned char>(bytes[i]));
+        hex[2] = (i + 1 == bytes.size()) ? '\n' : ' ';
+        writer.write(hex, 3);
+    }
+}
+
+static unsigned reg(Register r) noexcept {
+    return static_cast<unsigned>(r);
+}
+
+static unsigned char* append_u32(
+        unsigned char* out,
+        std::uint32_t value) noexcept {
+
+    for (int i = 0; i < 4; ++i) {
+        *out++ = 0xff & (value >> (8 * i));
+    }
+    return out;
+}
+
+/* Condition code of a conditional branch, e.g. 0x4 for "e". */
+static unsigned condition(Opcode opcode) noexcept {
+    switch (opcode) {
+    case Opcode::je_rel8:
+    case Opcode::je_rel32:
+        return 0x4;
+    case Opcode::jne_rel8:
+    case Opcode::jne_rel32:
+        return 0x5;
+    case Opcode::jl_rel8:
+    case Opcode::jl_rel32:
+        return 0xC;
+    case Opcode::jge_rel8:
+    case Opcode::jge_rel32:
+        return 0xD;
+    case Opcode::jle_rel8:
+    case Opcode::jle_rel32:
+        return 0xE;
+    default:
+        return 0xF;
+    }
+}
+
+/*
+ * The short forms of "add_eax_imm" and "cmp_eax_imm" are those of the
+ * compiler header, all other registers use the ModR/M forms.
+ */
+unsigned char* encode(
+        const Instruction& instruction,
+        std::uint32_t operand,
+        unsigned char* out) noexcept {
+
+    const unsigned r = reg(instruction.m_r);
+    const unsigned s = reg(instruction.m_s);
+
+    /* "op r/m32, r32" with `r` in r/m and `s` in reg */
+    const auto rm_reg = [&](unsigned char opcode) {
+        *out++ = opcode;
+        *out++ = 0xC0 | s << 3 | r;
+    };
+
+    switch (instruction.m_opcode) {
+    case Opcode::add_reg_reg:
+        rm_reg(0x01);
+        break;
+    case Opcode::add_reg_imm:
+        if (instruction.m_r == Register::eax) {
+            *out++ = 0x05;
+        } else {
+            *out++ = 0x81;
+            *out++ = 0xC0 + r;
+        }
+        break;
+    case Opcode::and_reg_reg:
+        rm_reg(0x21);
+        break;
+    case Opcode::call_ref_reg:
+        *out++ = 0xFF;
+        *out++ = 0x10 | r;
+        break;
+    case Opcode::call_rel32:
+        *out++ = 0xE8;
+        break;
+    case Opcode::cdq:
+        *out++ = 0x99;
+        break;
+    case Opcode::cmp_reg_reg:
+        rm_reg(0x39);
+        break;
+    case Opcode::cmp_reg_imm:
+        if (instruction.m_r == Register::eax) {
+            *out++ = 0x3D;
+        } else {
+            *out++ = 0x81;
+            *out++ = 0xF8 + r;
+        }
+        break;
+    case Opcode::hop_ne:
+        *out++ = 0x75;
+        *out++ = 0x07;
+        break;
+    case Opcode::idiv_reg:
+        *out++ = 0xF7;
+        *out++ = 0xF8 + r;
+        break;
+    case Opcode::idiv_ref_esp:
+        *out++ = 0xF7;
+        *out++ = 0x3C;
+        *out++ = 0x24;
+        break;
+    case Opcode::imul_reg_reg:
+        *out++ = 0x0F;
+        *out++ = 0xAF;
+        *out++ = 0xC0 | r << 3 | s;
+        break;
+    case Opcode::int_80:
+        *out++ = 0xCD;
+        *out++ = 0x80;
+        break;
+    case Opcode::je_rel8:
+    case Opcode::jg_rel8:
+    case Opcode::jge_rel8:
+    case Opcode::jl_rel8:
+    case Opcode::jle_rel8:
+    case Opcode::jne_rel8:
+        *out++ = 0x70 | condition(instruction.m_opcode);
+        break;
+    case Opcode::je_rel32:
+    case Opcode::jg_rel32:
+    case Opcode::jge_rel32:
+    case Opcode::jl_rel32:
+    case Opcode::jle_rel32:
+    case Opcode::jne_rel32:
+        *out++ = 0x0F;
+        *out++ = 0x80 | condition(instruction.m_opcode);
+        break;
+    case Opcode::jmp_reg:
+        *out++ = 0xFF;
+        *out++ = 0xE0 + r;
+        break;
+    case Opcode::jmp_rel8:
+        *out++ = 0xEB;
+        break;
+    case Opcode::jmp_rel32:
+        *out++ = 0xE9;
+        break;
+    case Opcode::mov_reg_reg:
+        rm_reg(0x89);
+        break;
+    case Opcode::mov_reg_imm:
+        *out++ = 0xB8 + r;
+        break;
+    case Opcode::mov_reg_ref_reg:
+        *out++ = 0x8B;
+        *out++ = r << 3 | s;
+        break;
+    case Opcode::mov_reg_ref_ebp_imm:
+        *out++ = 0x8B;
+        *out++ = 0x85 | r << 3;
+        break;
+    case Opcode::mov_ref_reg_reg:
+        *out++ = 0x89;
+        *out++ = s << 3 | r;
+        break;
+    case Opcode::movzx_reg_byte:
+        *out++ = 0x0F;
+        *out++ = 0xB6;
+        *out++ = 0xC0 | r << 3 | r;
+        break;
+    case Opcode::neg_reg:
+        *out++ = 0xF7;
+        *out++ = 0xD8 + r;
+        break;
+    case Opcode::not_reg:
+        *out++ = 0xF7;
+        *out++ = 0xD0 + r;
+        break;
+    case Opcode::or_reg_reg:
+        rm_reg(0x09);
+        break;
+    case Opcode::pop_reg:
+        *out++ = 0x58 + r;
+        break;
+    case Opcode::push_reg:
+        *out++ = 0x50 + r;
+        break;
+    case Opcode::push_imm:
+        *out++ = 0x68;
+        break;
+    case Opcode::ret:
+        *out++ = 0xC3;
+        break;
+    case Opcode::sete_byte:
+    case Opcode::setg_byte:
+    case Opcode::setge_byte:
+    case Opcode::setl_byte:
+    case Opcode::setle_byte:
+    case Opcode::setne_byte: {
+        static const unsigned char conditions[] = {
+            0x94, 0x9F, 0x9D, 0x9C, 0x9E, 0x95
+        };
+        const auto index = static_cast<int>(instruction.m_opcode) -
+            static_cast<int>(Opcode::sete_byte);
+        *out++ = 0x0F;
+        *out++ = conditions[index];
+        *out++ = 0xC0 + r;
+        break;
+    }
+    case Opcode::sub_reg_reg:
+        rm_reg(0x29);
+        break;
+    case Opcode::sub_reg_imm:
+        *out++ = 0x81;
+        *out++ = 0xE8 + r;
+        break;
+    case Opcode::xchg_reg_reg:
+        /* only with eax, see `xchg_eax_R` */
+        *out++ = 0x90 + s;
+        break;
+    case Opcode::xor_reg_reg:
+        rm_reg(0x31);
+        break;
+    case Opcode::label:
+    case Opcode::data:
+    case Opcode::text:
+        break;
+    }
+
+    if (is_short_branch(instruction.m_opcode)) {
+        *out++ = 0xff & operand;
+    } else if (instruction.m_operand != Operand::none) {
+        out = append_u32(out, operand);
+    }
+
+    return out;
+}
+
+std::uint32_t resolve_label(
+        const std::vector<std::optional<std::uint32_t>>& addresses,
+        std::uint32_t label) noexcept {
+
+    if (label < addresses.size() && addresses[label]) {
+        return *addresses[label];
+    }
+
+    char name[16];
+    const char* end = append_label(name, label);
+    std::cerr
+        << "Error: Undefined label \""
+        << std::string_view { name, static_cast<std::size_t>(end - name) }
+        << "\"\n";
+    std::exit(1);
+}
+
+void print(const Code& code, Writer& writer) noexcept {
+    for (const Instruction& item : code.items()) {
+        switch (item.m_opcode) {
+        case Opcode::label: {
+            char line[16];
+            char* out = line;
+            *out++ = '.';
+            out = append_label(out, item.m_value);
+            *out++ = ':';
+            *out++ = '\n';
+            writer.write(line, static_cast<std::size_t>(out - line));
+            break;
+        }
+        case Opcode::data:
+            print_data(code.pooled(item), writer);
+            break;
+        case Opcode::text:
+            writer << code.pooled(item);
+            break;
+        default:
+            print_instruction(item, writer);
+            break;
+        }
+    }
+}
+
+} /* namespace arabilis */
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef IR_H_
+#define IR_H_
+
+#include "io.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace arabilis {
+
+/* General purpose registers, numbered as in the instruction encoding. */
+enum class Register : std::uint8_t {
+    eax,
+    ecx,
+    edx,
+    ebx,
+    esp,
+    ebp,
+    esi,
+    edi
+};
+
+/*
+ * Instructions, one per family of macros. In the macro names, "R" and "S"
+ * stand for the two registers of an instruction and "B" for the low byte
+ * of "R". E.g. `mov_reg_reg` with eax and ebp is "mov_eax_ebp".
+ */
+enum class Opcode : std::uint8_t {
+    add_reg_reg,            /* add_R_S */
+    add_reg_imm,            /* add_R_imm */
+    and_reg_reg,            /* and_R_S */
+    call_ref_reg,           /* call_ref_R */
+    call_rel32,             /* call_rel32 */
+    cdq,                    /* cdq */
+    cmp_reg_reg,            /* cmp_R_S */
+    cmp_reg_imm,            /* cmp_R_imm */
+    hop_ne,                 /* hop_ne */
+    idiv_reg,               /* idiv_R */
+    idiv_ref_esp,           /* idiv_ref_esp */
+    imul_reg_reg,           /* imul_R_S */
+    int_80,                 /* int_80 */
+    je_rel8,                /* je_rel8 */
+    je_rel32,               /* je_rel32 */
+    jg_rel8,                /* jg_rel8 */
+    jg_rel32,               /* jg_rel32 */
+    jge_rel8,               /* jge_rel8 */
+    jge_rel32,              /* jge_rel32 */
+    jl_rel8,                /* jl_rel8 */
+    jl_rel32,               /* jl_rel32 */
+    jle_rel8,               /* jle_rel8 */
+    jle_rel32,              /* jle_rel32 */
+    jmp_reg,                /* jmp_R */
+    jmp_rel8,               /* jmp_rel8 */
+    jmp_rel32,              /* jmp_rel32 */
+    jne_rel8,               /* jne_rel8 */
+    jne_rel32,              /* jne_rel32 */
+    mov_reg_reg,            /* mov_R_S */
+    mov_reg_imm,            /* mov_R_imm */
+    mov_reg_ref_reg,        /* mov_R_ref_S */
+    mov_reg_ref_ebp_imm,    /* mov_R_ref_ebp_imm */
+    mov_ref_reg_reg,        /* mov_ref_R_S */
+    movzx_reg_byte,         /* movzx_R_B */
+    neg_reg,                /* neg_R */
+    not_reg,                /* not_R */
+    or_reg_reg,             /* or_R_S */
+    pop_reg,                /* pop_R */
+    push_reg,               /* push_R */
+    push_imm,               /* push_imm */
+    ret,                    /* ret */
+    sete_byte,              /* sete_B */
+    setg_byte,              /* setg_B */
+    setge_byte,             /* setge_B */
+    setl_byte,              /* setl_B */
+    setle_byte,             /* setle_B */
+    setne_byte,             /* setne_B */
+    sub_reg_reg,            /* sub_R_S */
+    sub_reg_imm,            /* sub_R_imm */
+    xchg_reg_reg,           /* xchg_R_S */
+    xor_reg_reg,            /* xor_R_S */
+
+    /* not instructions */
+    label,                  /* definition of a label */
+    data,                   /* raw bytes */
+    text                    /* verbatim text, e.g. comments */
+};
+
+/* Whether a code item is an instruction rather than a label, data or text. */
+constexpr bool is_instruction(Opcode opcode) noexcept {
+    return opcode < Opcode::label;
+}
+
+/*
+ * Relative branches and calls. Their operand is the label of the target
+ * until `relax_branches` replaces it with the displacement.
+ */
+constexpr bool is_relative_branch(Opcode opcode) noexcept {
+    return opcode == Opcode::call_rel32 ||
+        (opcode >= Opcode::je_rel8 && opcode <= Opcode::jle_rel32) ||
+        (opcode >= Opcode::jmp_rel8 && opcode <= Opcode::jne_rel32);
+}
+
+/*
+ * Relative branches with an 8 bit displacement, each is followed by its
+ * 32 bit form in `Opcode`.
+ */
+constexpr bool is_short_branch(Opcode opcode) noexcept {
+    switch (opcode) {
+    case Opcode::je_rel8:
+    case Opcode::jg_rel8:
+    case Opcode::jge_rel8:
+    case Opcode::jl_rel8:
+    case Opcode::jle_rel8:
+    case Opcode::jmp_rel8:
+    case Opcode::jne_rel8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Label, printed as "l" followed by at least three base 36 digits. */
+enum class Label : std::uint32_t {
+    none = 0
+};
+
+struct Immediate {
+    std::uint32_t m_value;
+
+    /* Printed as four separate bytes, "00 00 00 00" instead of "00000000". */
+    bool m_bytes { false };
+};
+
+enum class Operand : std::uint8_t {
+    none,
+    immediate,
+    immediate_bytes,
+    label
+};
+
+/* One item of code. Registers that an instruction does not have are eax. */
+struct Instruction {
+    Opcode m_opcode;
+    Register m_r;
+    Register m_s;
+    Operand m_operand;
+
+    /* Immediate or label. Offset into the pool for data and text. */
+    std::uint32_t m_value;
+
+    /* Size in the pool for data and text. */
+    std::uint32_t m_size;
+};
+
+/* A program as a sequence of instructions, labels, data and text. */
+class Code {
+public:
+    Code() noexcept = default;
+
+    Code(const Code&) noexcept = delete;
+    Code& operator=(const Code&) noexcept = delete;
+
+    Code(Code&&) noexcept = default;
+    Code& operator=(Code&&) noexcept = default;
+
+    ~Code() noexcept = default;
+
+    void reserve(std::size_t items) noexcept {
+        m_items.reserve(items);
+    }
+
+    void add(Opcode opcode) noexcept {
+        add(opcode, Register::eax, Register::eax);
+    }
+
+    void add(Opcode opcode, Register r) noexcept {
+        add(opcode, r, r);
+    }
+
+    void add(Opcode opcode, Register r, Register s) noexcept {
+        m_items.push_back({ opcode, r, s, Operand::none, 0, 0 });
+    }
+
+    void add(Opcode opcode, Immediate immediate) noexcept {
+        add(opcode, Register::eax, immediate);
+    }
+
+    void add(Opcode opcode, Register r, Immediate immediate) noexcept {
+        m_items.push_back({
+            opcode,
+            r,
+            r,
+            immediate.m_bytes ? Operand::immediate_bytes : Operand::immediate,
+            immediate.m_value,
+            0
+        });
+    }
+
+    void add(Opcode opcode, Label label) noexcept {
+        add(opcode, Register::eax, label);
+    }
+
+    void add(Opcode opcode, Register r, Label label) noexcept {
+        m_items.push_back({
+            opcode,
+            r,
+            r,
+            Operand::label,
+            static_cast<std::uint32_t>(label),
+            0
+        });
+    }
+
+    void define(Label label) noexcept {
+        add(Opcode::label, label);
+    }
+
+    void add_data(std::string_view bytes) noexcept {
+        add_pooled(Opcode::data, bytes);
+    }
+
+    void add_text(std::string_view text) noexcept {
+        add_pooled(Opcode::text, text);
+    }
+
+    [[nodiscard]] const std::vector<Instruction>& items() const noexcept {
+        return m_items;
+    }
+
+    /* Items for passes to rewrite. Data and text must stay as they are. */
+    [[nodiscard]] std::vector<Instruction>& items() noexcept {
+        return m_items;
+    }
+
+    /* Bytes of a data or text item. */
+    [[nodiscard]] std::string_view pooled(
+            const Instruction& item) const noexcept {
+        return std::string_view { m_pool }.substr(item.m_value, item.m_size);
+    }
+
+private:
+    std::vector<Instruction> m_items {};
+    std::string m_pool {};
+
+    void add_pooled(Opcode opcode, std::string_view bytes) noexcept {
+        m_items.push_back({
+            opcode,
+            Register::eax,
+            Register::eax,
+            Operand::none,
+            static_cast<std::uint32_t>(m_pool.size()),
+            static_cast<std::uint32_t>(bytes.size())
+        });
+        m_pool += bytes;
+    }
+};
+
+/* Name of a register, e.g. "eax". */
+[[nodiscard]] const char* name(Register) noexcept;
+
+/* Name of the low byte of eax, ecx, edx or ebx, e.g. "al". */
+[[nodiscard]] const char* byte_name(Register) noexcept;
+
+/* Longest encoding of an instruction: two opcode bytes, ModR/M and imm32. */
+constexpr std::size_t max_instruction_size = 8;
+
+/*
+ * Encode an instruction as its macro does, with `operand` in place of its
+ * immediate or label. Return the end of the encoding.
+ */
+unsigned char* encode(
+        const Instruction&,
+        std::uint32_t operand,
+        unsigned char* out) noexcept;
+
+/*
+ * Address of a label, from addresses indexed by label. A label that was never
+ * defined is an error, as in `label2hex`.
+ */
+std::uint32_t resolve_label(
+        const std::vector<std::optional<std::uint32_t>>& addresses,
+        std::uint32_t label) noexcept;
+
+/* Render code as macro text. */
+void print(const Code&, Writer&) noexcept;
+
+} /* namespace arabilis */
+
+#endif /* IR_H_ */
@@ -0,0 +1,742 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+/*
+ * Generates the lexer's transition table from the grammar in
+ * "doc/grammar/arabilis.g".
+ *
+ * The lexer rules (upper case names) and all non-alphabetic literals used in
+ * parser rules, e.g. '(' or '&&', are turned into one NFA, which is then
+ * converted into a minimal DFA. Input bytes that no rule tells apart share
+ * one byte class. Keywords are left to the lexer, which recognizes them
+ * among identifiers.
+ *
+ * Usage: arabilis_lexgen <grammar file> <output header>
+ */
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ByteSet = std::bitset<256>;
+
+[[noreturn]] static void fail(const std::string& message) {
+    std::cerr << "Error: " << message << '\n';
+    std::exit(1);
+}
+
+/* Grammar file tokenizer. */
+
+struct GrammarToken {
+    enum Kind {
+        name,
+        literal,
+        action,
+        symbol,
+        end
+    };
+
+    Kind m_kind;
+    std::string m_text;
+};
+
+static std::vector<GrammarToken> tokenize(const std::string& text) {
+    std::vector<GrammarToken> tokens {};
+    std::size_t i = 0;
+
+    while (i < text.size()) {
+        const char c = text[i];
+
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            i += 1;
+            continue;
+        }
+
+        if (text.compare(i, 2, "//") == 0) {
+            i = text.find('\n', i);
+            i = (i == std::string::npos) ? text.size() : i;
+            continue;
+        }
+
+        if (text.compare(i, 2, "/*") == 0) {
+            i = text.find("*/", i);
+            if (i == std::string::npos) {
+                fail("Unterminated comment in grammar");
+            }
+            i += 2;
+            continue;
+        }
+
+        if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            std::size_t end = i;
+            while (end < text.size() &&
+                    (std::isalnum(static_cast<unsigned char>(text[end])) ||
+                    text[end] == '_')) {
+                end += 1;
+            }
+            tokens.push_back({ GrammarToken::name, text.substr(i, end - i) });
+            i = end;
+            continue;
+        }
+
+        if (c == '\'') {
+            std::string value {};
+            i += 1;
+            while (i < text.size() && text[i] != '\'') {
+                char v = text[i];
+                if (v == '\\') {
+                    i += 1;
+                    v = text[i];
+                    switch (v) {
+                    case 'n':
+                        v = '\n';
+                        break;
+                    case 'r':
+                        v = '\r';
+                        break;
+                    case 't':
+                        v = '\t';
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                value += v;
+                i += 1;
+            }
+            if (i == text.size()) {
+                fail("Unterminated literal in grammar");
+            }
+            i += 1;
+            tokens.push_back({ GrammarToken::literal, value });
+            continue;
+        }
+
+        if (c == '{') {
+            int depth = 0;
+            std::size_t end = i;
+            do {
+                if (end == text.size()) {
+                    fail("Unterminated action in grammar");
+                }
+                depth += (text[end] == '{') - (text[end] == '}');
+                end += 1;
+            } while (depth > 0);
+            tokens.push_back({ GrammarToken::action, text.substr(i, end - i) });
+            i = end;
+            continue;
+        }
+
+        if (text.compare(i, 2, "..") == 0) {
+            tokens.push_back({ GrammarToken::symbol, ".." });
+            i += 2;
+            continue;
+        }
+
+        if (std::string { ":;|()*+?~" }.find(c) != std::string::npos) {
+            tokens.push_back({ GrammarToken::symbol, std::string { c } });
+            i += 1;
+            continue;
+        }
+
+        fail(std::string { "Unexpected character in grammar: " } + c);
+    }
+
+    tokens.push_back({ GrammarToken::end, "" });
+    return tokens;
+}
+
+/* Regular expressions of lexer rules. */
+
+struct Regex {
+    enum Kind {
+        set,
+        sequence,
+        alternative,
+        star,
+        plus,
+        optional
+    };
+
+    Kind m_kind;
+    ByteSet m_set {};
+    std::vector<Regex> m_children {};
+};
+
+class RuleParser {
+public:
+    explicit RuleParser(const std::vector<GrammarToken>& tokens) :
+            m_tokens { tokens } {
+    }
+
+    /* Parse a lexer rule body, up to and including the final ';'. */
+    Regex parse_rule(bool& hidden) {
+        m_hidden = false;
+        Regex regex = parse_alternative();
+        expect(";");
+        hidden = m_hidden;
+        return regex;
+    }
+
+    /* Collect all literals of a parser rule, up to and including ';'. */
+    void skip_rule(std::vector<std::string>& literals) {
+        while (!is(";")) {
+            if (peek().m_kind == GrammarToken::end) {
+                fail("Unterminated rule in grammar");
+            }
+            if (peek().m_kind == GrammarToken::literal) {
+                literals.push_back(peek().m_text);
+            }
+            m_index += 1;
+        }
+        m_index += 1;
+    }
+
+    const GrammarToken& peek() const {
+        return m_tokens[m_index];
+    }
+
+    const GrammarToken& take() {
+        return m_tokens[m_index++];
+    }
+
+    bool is(const char* symbol) const {
+        return peek().m_kind == GrammarToken::symbol && peek().m_text == symbol;
+    }
+
+    void expect(const char* symbol) {
+        if (!is(symbol)) {
+            fail(std::string { "Expected '" } + symbol + "' in grammar, " +
+                "found '" + peek().m_text + "'");
+        }
+        m_index += 1;
+    }
+
+private:
+    const std::vector<GrammarToken>& m_tokens;
+    std::size_t m_index { 0 };
+    bool m_hidden { false };
+
+    Regex parse_alternative() {
+        Regex regex { Regex::alternative };
+        regex.m_children.push_back(parse_sequence());
+        while (is("|")) {
+            m_index += 1;
+            regex.m_children.push_back(parse_sequence());
+        }
+        return regex;
+    }
+
+    Regex parse_sequence() {
+        Regex regex { Regex::sequence };
+        while (!is("|") && !is(")") && !is(";")) {
+            if (peek().m_kind == GrammarToken::action) {
+                m_hidden |= take().m_text.find("HIDDEN") != std::string::npos;
+                continue;
+            }
+
+            Regex element = parse_atom();
+            if (is("*") || is("+") || is("?")) {
+                const std::string suffix = take().m_text;
+                const Regex::Kind kind =
+                    suffix == "*" ? Regex::star :
+                    suffix == "+" ? Regex::plus :
+                    Regex::optional;
+                element = Regex { kind, {}, { element } };
+            }
+            regex.m_children.push_back(element);
+        }
+        return regex;
+    }
+
+    Regex parse_atom() {
+        if (is("(")) {
+            m_index += 1;
+            Regex regex = parse_alternative();
+            expect(")");
+            return regex;
+        }
+
+        if (is("~")) {
+            m_index += 1;
+            Regex regex { Regex::set };
+            regex.m_set = ~as_set(parse_atom());
+            return regex;
+        }
+
+        if (peek().m_kind != GrammarToken::literal) {
+            fail("Unsupported element in lexer rule: '" + peek().m_text + "'");
+        }
+
+        const std::string text = take().m_text;
+        if (is("..")) {
+            m_index += 1;
+            if (peek().m_kind != GrammarToken::literal) {
+                fail("Expected literal after '..' in grammar");
+            }
+            const std::string last = take().m_text;
+            if (text.size() != 1 || last.size() != 1) {
+                fail("Ranges must be of single characters in grammar");
+            }
+
+            Regex regex { Regex::set };
+            for (int c = static_cast<unsigned char>(text[0]);
+                    c <= static_cast<unsigned char>(last[0]);
+                    ++c) {
+                regex.m_set.set(c);
+            }
+            return regex;
+        }
+
+        Regex regex { Regex::sequence };
+        for (const char c : text) {
+            Regex single { Regex::set };
+            single.m_set.set(static_cast<unsigned char>(c));
+            regex.m_children.push_back(single);
+        }
+        return regex;
+    }
+
+    /* Set of bytes matched by a regular expression matching single bytes. */
+    static ByteSet as_set(const Regex& regex) {
+        if (regex.m_kind == Regex::set) {
+            return regex.m_set;
+        }
+
+        if ((regex.m_kind == Regex::alternative ||
+                regex.m_kind == Regex::sequence) &&
+                (regex.m_kind == Regex::alternative ||
+                regex.m_children.size() == 1)) {
+            ByteSet set {};
+            for (const Regex& child : regex.m_children) {
+                set |= as_set(child);
+            }
+            return set;
+        }
+
+        fail("Operand of '~' must match a single character in grammar");
+    }
+};
+
+/* Token rules, in order of priority. */
+
+struct Rule {
+    std::string m_name;
+    bool m_hidden;
+    Regex m_regex;
+};
+
+static std::vector<Rule> read_rules(const std::string& text) {
+    const std::vector<GrammarToken> tokens = tokenize(text);
+    RuleParser parser { tokens };
+
+    if (parser.peek().m_text == "grammar") {
+        while (!parser.is(";")) {
+            parser.take();
+        }
+        parser.take();
+    }
+
+    std::vector<std::string> literals {};
+    std::vector<Rule> lexer_rules {};
+
+    while (parser.peek().m_kind != GrammarToken::end) {
+        if (parser.peek().m_kind != GrammarToken::name) {
+            fail("Expected rule name in grammar");
+        }
+
+        const std::string name = parser.take().m_text;
+        parser.expect(":");
+
+        if (std::isupper(static_cast<unsigned char>(name[0]))) {
+            bool hidden = false;
+            Regex regex = parser.parse_rule(hidden);
+            lexer_rules.push_back({ name, hidden, regex });
+        } else {
+            parser.skip_rule(literals);
+        }
+    }
+
+    /* implicit tokens from parser rules take precedence, keywords excluded */
+    std::vector<Rule> rules {};
+    std::set<std::string> seen {};
+    for (const std::string& literal : literals) {
+        if (std::isalpha(static_cast<unsigned char>(literal[0]))) {
+            continue;
+        }
+
+        if (!seen.insert(literal).second) {
+            continue;
+        }
+
+        Regex regex { Regex::sequence };
+        for (const char c : literal) {
+            Regex single { Regex::set };
+            single.m_set.set(static_cast<unsigned char>(c));
+            regex.m_children.push_back(single);
+        }
+        rules.push_back({ literal, false, regex });
+    }
+
+    std::move(
+        lexer_rules.begin(),
+        lexer_rules.end(),
+        std::back_inserter(rules));
+
+    return rules;
+}
+
+/* NFA, Thompson construction. */
+
+struct NfaState {
+    std::vector<std::pair<ByteSet, int>> m_edges {};
+    std::vector<int> m_epsilon {};
+    int m_rule { -1 };
+};
+
+class Nfa {
+public:
+    std::vector<NfaState> m_states {};
+
+    int add_state() {
+        m_states.emplace_back();
+        return static_cast<int>(m_states.size()) - 1;
+    }
+
+    /* Add states matching `regex` from `from`, return the final state. */
+    int build(const Regex& regex, int from) {
+        switch (regex.m_kind) {
+        case Regex::set: {
+            const int to = add_state();
+            m_states[from].m_edges.emplace_back(regex.m_set, to);
+            return to;
+        }
+
+        case Regex::sequence:
+            for (const Regex& child : regex.m_children) {
+                from = build(child, from);
+            }
+            return from;
+
+        case Regex::alternative: {
+            const int to = add_state();
+            for (const Regex& child : regex.m_children) {
+                const int begin = add_state();
+                m_states[from].m_epsilon.push_back(begin);
+                const int end = build(child, begin);
+                m_states[end].m_epsilon.push_back(to);
+            }
+            return to;
+        }
+
+        case Regex::star:
+        case Regex::plus:
+        case Regex::optional: {
+            const int begin = add_state();
+            const int to = add_state();
+            m_states[from].m_epsilon.push_back(begin);
+            const int end = build(regex.m_children[0], begin);
+            m_states[end].m_epsilon.push_back(to);
+            if (regex.m_kind != Regex::plus) {
+                m_states[from].m_epsilon.push_back(to);
+            }
+            if (regex.m_kind != Regex::optional) {
+                m_states[end].m_epsilon.push_back(begin);
+            }
+            return to;
+        }
+        }
+
+        return from;
+    }
+
+    std::set<int> closure(std::set<int> states) const {
+        std::vector<int> todo { states.begin(), states.end() };
+        while (!todo.empty()) {
+            const int state = todo.back();
+            todo.pop_back();
+            for (const int next : m_states[state].m_epsilon) {
+                if (states.insert(next).second) {
+                    todo.push_back(next);
+                }
+            }
+        }
+        return states;
+    }
+};
+
+/* DFA, subset construction and minimization. */
+
+struct Dfa {
+    /* state 0 rejects, state 1 is the start state */
+    std::vector<std::vector<int>> m_transitions {};
+    std::vector<int> m_rules {};
+    std::vector<int> m_byte_class {};
+    int m_class_count { 0 };
+};
+
+static Dfa build_dfa(const std::vector<Rule>& rules) {
+    Nfa nfa {};
+    const int start = nfa.add_state();
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        const int begin = nfa.add_state();
+        nfa.m_states[start].m_epsilon.push_back(begin);
+        const int end = nfa.build(rules[i].m_regex, begin);
+        nfa.m_states[end].m_rule = static_cast<int>(i);
+    }
+
+    Dfa dfa {};
+
+    /* bytes that take the same edges everywhere share one class */
+    std::vector<ByteSet> edge_sets {};
+    for (const NfaState& state : nfa.m_states) {
+        for (const auto& edge : state.m_edges) {
+            edge_sets.push_back(edge.first);
+        }
+    }
+
+    std::map<std::vector<bool>, int> signatures {};
+    std::vector<int> representative {};
+    dfa.m_byte_class.resize(256);
+    for (int byte = 0; byte < 256; ++byte) {
+        std::vector<bool> signature {};
+        for (const ByteSet& set : edge_sets) {
+            signature.push_back(set.test(byte));
+        }
+
+        const auto inserted = signatures.emplace(
+            signature,
+            static_cast<int>(signatures.size()));
+        if (inserted.second) {
+            representative.push_back(byte);
+        }
+        dfa.m_byte_class[byte] = inserted.first->second;
+    }
+    dfa.m_class_count = static_cast<int>(signatures.size());
+
+    std::map<std::set<int>, int> ids {};
+    std::vector<std::set<int>> subsets {};
+    const auto lookup = [&](const std::set<int>& subset) {
+        const auto inserted = ids.emplace(
+            subset,
+            static_cast<int>(subsets.size()));
+        if (inserted.second) {
+            subsets.push_back(subset);
+        }
+        return inserted.first->second;
+    };
+
+    lookup({});
+    lookup(nfa.closure({ start }));
+
+    for (std::size_t i = 0; i < subsets.size(); ++i) {
+        std::vector<int> row(dfa.m_class_count, 0);
+        for (int c = 0; c < dfa.m_class_count; ++c) {
+            std::set<int> next {};
+            for (const int state : subsets[i]) {
+                for (const auto& edge : nfa.m_states[state].m_edges) {
+                    if (edge.first.test(representative[c])) {
+                        next.insert(edge.second);
+                    }
+                }
+            }
+            row[c] = lookup(nfa.closure(next));
+        }
+        dfa.m_transitions.push_back(row);
+
+        int rule = -1;
+        for (const int state : subsets[i]) {
+            const int candidate = nfa.m_states[state].m_rule;
+            if (candidate >= 0 && (rule < 0 || candidate < rule)) {
+                rule = candidate;
+            }
+        }
+        dfa.m_rules.push_back(rule);
+    }
+
+    return dfa;
+}
+
+static Dfa minimize(const Dfa& dfa) {
+    const int count = static_cast<int>(dfa.m_transitions.size());
+
+    /* start with one block per accepted rule, then refine */
+    std::vector<int> block(count);
+    for (int i = 0; i < count; ++i) {
+        block[i] = dfa.m_rules[i] + 1;
+    }
+
+    for (;;) {
+        std::map<std::vector<int>, int> signatures {};
+        std::vector<int> refined(count);
+        for (int i = 0; i < count; ++i) {
+            std::vector<int> signature { block[i] };
+            for (const int next : dfa.m_transitions[i]) {
+                signature.push_back(block[next]);
+            }
+            refined[i] = signatures.emplace(
+                signature,
+                static_cast<int>(signatures.size())).first->second;
+        }
+
+        const bool stable =
+            std::set<int>(refined.begin(), refined.end()).size() ==
+            std::set<int>(block.begin(), block.end()).size();
+        block = refined;
+        if (stable) {
+            break;
+        }
+    }
+
+    /* renumber in breadth-first order, keeping 0 and 1 in place */
+    std::vector<int> order { 0, 1 };
+    std::map<int, int> ids { { block[0], 0 }, { block[1], 1 } };
+    for (std::size_t i = 1; i < order.size(); ++i) {
+        for (const int next : dfa.m_transitions[order[i]]) {
+            if (ids.emplace(block[next], static_cast<int>(ids.size())).second) {
+                order.push_back(next);
+            }
+        }
+    }
+
+    Dfa minimal {};
+    minimal.m_byte_class = dfa.m_byte_class;
+    minimal.m_class_count = dfa.m_class_count;
+    for (const int state : order) {
+        std::vector<int> row {};
+        for (const int next : dfa.m_transitions[state]) {
+            row.push_back(ids.at(block[next]));
+        }
+        minimal.m_transitions.push_back(row);
+        minimal.m_rules.push_back(dfa.m_rules[state]);
+    }
+
+    return minimal;
+}
+
+/* Output. */
+
+static std::string quote(const std::string& text) {
+    std::string quoted { "\"" };
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+static void write_table(
+        std::ostream& out,
+        const std::vector<Rule>& rules,
+        const Dfa& dfa) {
+
+    if (dfa.m_transitions.size() > 255 || dfa.m_class_count > 255) {
+        fail("Transition table too large");
+    }
+
+    out
+        << "// Generated by arabilis_lexgen from arabilis.g. Do not edit.\n"
+        << "\n"
+        << "#ifndef LEXER_TABLE_H_\n"
+        << "#define LEXER_TABLE_H_\n"
+        << "\n"
+        << "#include <cstdint>\n"
+        << "\n"
+        << "namespace arabilis::lexer_table {\n"
+        << "\n"
+        << "constexpr int state_count = " << dfa.m_transitions.size() << ";\n"
+        << "constexpr int class_count = " << dfa.m_class_count << ";\n"
+        << "\n"
+        << "/* Rejecting state and start state. */\n"
+        << "constexpr std::uint8_t state_reject = 0;\n"
+        << "constexpr std::uint8_t state_start = 1;\n"
+        << "\n"
+        << "constexpr std::uint8_t byte_class[256] = {";
+
+    for (int byte = 0; byte < 256; ++byte) {
+        out << (byte % 16 == 0 ? "\n    " : " ") << dfa.m_byte_class[byte] << ',';
+    }
+
+    out
+        << "\n};\n"
+        << "\n"
+        << "constexpr std::uint8_t transitions[state_count][class_count] = {\n";
+
+    for (const auto& row : dfa.m_transitions) {
+        out << "    {";
+        for (std::size_t c = 0; c < row.size(); ++c) {
+            out << (c == 0 ? " " : ", ") << row[c];
+        }
+        out << " },\n";
+    }
+
+    out
+        << "};\n"
+        << "\n"
+        << "/* Rule or literal accepted in each state, nullptr if none. */\n"
+        << "constexpr const char* accepts[state_count] = {\n";
+
+    for (const int rule : dfa.m_rules) {
+        out
+            << "    "
+            << (rule < 0 ? "nullptr" : quote(rules[rule].m_name))
+            << ",\n";
+    }
+
+    out
+        << "};\n"
+        << "\n"
+        << "/* Whether the accepted token is discarded, e.g. whitespace. */\n"
+        << "constexpr bool hidden[state_count] = {\n";
+
+    for (const int rule : dfa.m_rules) {
+        out
+            << "    "
+            << (rule >= 0 && rules[rule].m_hidden ? "true" : "false")
+            << ",\n";
+    }
+
+    out
+        << "};\n"
+        << "\n"
+        << "} /* namespace arabilis::lexer_table */\n"
+        << "\n"
+        << "#endif /* LEXER_TABLE_H_ */\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: arabilis_lexgen <grammar file> <output header>\n";
+        return 1;
+    }
+
+    std::ifstream in { argv[1] };
+    if (!in) {
+        fail(std::string { "Unable to open input file \"" } + argv[1] + "\"");
+    }
+
+    std::stringstream text {};
+    text << in.rdbuf();
+
+    const std::vector<Rule> rules = read_rules(text.str());
+    const Dfa dfa = minimize(build_dfa(rules));
+
+    std::ofstream out { argv[2] };
+    if (!out) {
+        fail(std::string { "Unable to open output file \"" } + argv[2] + "\"");
+    }
+
+    write_table(out, rules, dfa);
+    return 0;
+}
@@ -0,0 +1,1059 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "optimizer.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace arabilis {
+
+/* Result of a unary operator on a constant, as computed by the backend. */
+static int apply(Token token, int rhs) noexcept {
+    const auto value = static_cast<std::uint32_t>(rhs);
+
+    switch (token) {
+    case Token::token_minus:
+        return static_cast<int>(0u - value);
+    case Token::token_bit_not:
+        return static_cast<int>(~value);
+    case Token::token_log_not:
+        return rhs == 0;
+    default:
+        return rhs;
+    }
+}
+
+/* Result of a binary operator on constants, unless the operation traps. */
+static std::optional<int> apply(Token token, int lhs, int rhs) noexcept {
+    const auto a = static_cast<std::uint32_t>(lhs);
+    const auto b = static_cast<std::uint32_t>(rhs);
+
+    switch (token) {
+    case Token::token_plus:
+        return static_cast<int>(a + b);
+    case Token::token_minus:
+        return static_cast<int>(a - b);
+    case Token::token_multiply:
+        return static_cast<int>(a * b);
+    case Token::token_divide:
+    case Token::token_modulo:
+        /* "idiv" raises #DE for these */
+        if (rhs == 0 || (lhs == INT32_MIN && rhs == -1)) {
+            return std::nullopt;
+        }
+        return (token == Token::token_divide) ? lhs / rhs : lhs % rhs;
+    case Token::token_log_and:
+        return (lhs != 0) && (rhs != 0);
+    case Token::token_log_or:
+        return (lhs != 0) || (rhs != 0);
+    case Token::token_bit_and:
+        return static_cast<int>(a & b);
+    case Token::token_bit_or:
+        return static_cast<int>(a | b);
+    case Token::token_bit_xor:
+        return static_cast<int>(a ^ b);
+    case Token::token_equal:
+        return lhs == rhs;
+    case Token::token_notequal:
+        return lhs != rhs;
+    case Token::token_less:
+        return lhs < rhs;
+    case Token::token_lessequal:
+        return lhs <= rhs;
+    case Token::token_greater:
+        return lhs > rhs;
+    case Token::token_greaterequal:
+        return lhs >= rhs;
+    default:
+        return std::nullopt;
+    }
+}
+
+class ConstantFolder {
+public:
+    explicit ConstantFolder(const FlatAst& ast, FlatAst& folded) noexcept :
+            m_ast { ast },
+            m_folded { folded },
+            m_values(ast.size()),
+            m_pure(ast.size(), true) {
+    }
+
+    ConstantFolder(const ConstantFolder&) noexcept = delete;
+    ConstantFolder& operator=(const ConstantFolder&) noexcept = delete;
+
+    ConstantFolder(ConstantFolder&&) noexcept = default;
+    ConstantFolder& operator=(ConstantFolder&&) noexcept = delete;
+
+    ~ConstantFolder() noexcept = default;
+
+    void fold_program() noexcept;
+
+private:
+    const FlatAst& m_ast;
+    FlatAst& m_folded;
+
+    /* node -> value of the expression, if it is constant. */
+    std::vector<std::optional<int>> m_values;
+
+    /* node -> whether the expression may be dropped without being run. */
+    std::vector<bool> m_pure;
+
+    /** Find constant and pure expressions, children before parents. */
+    void evaluate() noexcept;
+
+    /** Value of a binary operator, if constant. */
+    std::optional<int> evaluate_bin_op(NodeIndex) const noexcept;
+
+    /** Operand a binary operator reduces to, if the other is neutral. */
+    std::optional<NodeIndex> reduce_bin_op(NodeIndex) const noexcept;
+
+    /** Append the folded copy of a subtree, return the index of its root. */
+    NodeIndex fold(NodeIndex) noexcept;
+
+    /** Fold subtrees and append the list of their roots. */
+    std::uint32_t fold_list(const FlatList&) noexcept;
+};
+
+FlatAst fold_constants(const FlatAst& ast) noexcept {
+    FlatAst folded { ast.filename(), ast.symbols() };
+    ConstantFolder folder { ast, folded };
+    folder.fold_program();
+    return folded;
+}
+
+void ConstantFolder::fold_program() noexcept {
+    evaluate();
+
+    for (const NodeIndex globalvar : m_ast.globalvars()) {
+        m_folded.m_globalvars.push_back(fold(globalvar));
+    }
+
+    for (const NodeIndex function : m_ast.functions()) {
+        m_folded.m_functions.push_back(fold(function));
+    }
+}
+
+void ConstantFolder::evaluate() noexcept {
+    /* nodes are in pre-order, so children come after their parent */
+    for (NodeIndex node = m_ast.size(); node-- > 0;) {
+        switch (m_ast.kind(node)) {
+        case NodeKind::bin_op: {
+            const Token token = m_ast.token(node);
+            m_values[node] = evaluate_bin_op(node);
+            m_pure[node] = m_values[node] || (
+                m_pure[m_ast.child(node, 0)] &&
+                m_pure[m_ast.child(node, 1)] &&
+                token != Token::token_divide &&
+                token != Token::token_modulo);
+            break;
+        }
+        case NodeKind::call:
+            m_pure[node] = false;
+            break;
+        case NodeKind::numeral:
+            m_values[node] = m_ast.value(node);
+            break;
+        case NodeKind::un_op: {
+            const NodeIndex rhs = m_ast.child(node, 0);
+            if (m_values[rhs]) {
+                m_values[node] = apply(m_ast.token(node), *m_values[rhs]);
+            }
+            m_pure[node] = m_pure[rhs];
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+std::optional<int> ConstantFolder::evaluate_bin_op(
+        NodeIndex node) const noexcept {
+
+    const Token token = m_ast.token(node);
+    const NodeIndex lhs = m_ast.child(node, 0);
+    const NodeIndex rhs = m_ast.child(node, 1);
+    const std::optional<int>& a = m_values[lhs];
+    const std::optional<int>& b = m_values[rhs];
+
+    if (a && b) {
+        return apply(token, *a, *b);
+    }
+
+    /* an absorbing operand decides, if the other one may be dropped */
+    const std::optional<int>& known = a ? a : b;
+    if (!known || !m_pure[a ? rhs : lhs]) {
+        return std::nullopt;
+    }
+
+    switch (token) {
+    case Token::token_multiply:
+    case Token::token_bit_and:
+    case Token::token_log_and:
+        if (*known == 0) {
+            return 0;
+        }
+        break;
+    case Token::token_bit_or:
+        if (*known == -1) {
+            return -1;
+        }
+        break;
+    case Token::token_log_or:
+        if (*known != 0) {
+            return 1;
+        }
+        break;
+    case Token::token_modulo:
+        if (b && *b == 1) {
+            return 0;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<NodeIndex> ConstantFolder::reduce_bin_op(
+        NodeIndex node) const noexcept {
+
+    const NodeIndex lhs = m_ast.child(node, 0);
+    const NodeIndex rhs = m_ast.child(node, 1);
+    const std::optional<int>& a = m_values[lhs];
+    const std::optional<int>& b = m_values[rhs];
+
+    switch (m_ast.token(node)) {
+    case Token::token_plus:
+    case Token::token_bit_or:
+    case Token::token_bit_xor:
+        if (b && *b == 0) {
+            return lhs;
+        }
+        if (a && *a == 0) {
+            return rhs;
+        }
+        break;
+    case Token::token_minus:
+        if (b && *b == 0) {
+            return lhs;
+        }
+        break;
+    case Token::token_multiply:
+        if (b && *b == 1) {
+            return lhs;
+        }
+        if (a && *a == 1) {
+            return rhs;
+        }
+        break;
+    case Token::token_divide:
+        if (b && *b == 1) {
+            return lhs;
+        }
+        break;
+    case Token::token_bit_and:
+        if (b && *b == -1) {
+            return lhs;
+        }
+        if (a && *a == -1) {
+            return rhs;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return std::nullopt;
+}
+
+NodeIndex ConstantFolder::fold(NodeIndex node) noexcept {
+    const NodeKind kind = m_ast.kind(node);
+    const Position& position = m_ast.position(node);
+
+    if (m_values[node]) {
+        const NodeIndex index = m_folded.add(NodeKind::numeral, position);
+        m_folded.set(index, 0, static_cast<std::uint32_t>(*m_values[node]));
+        return index;
+    }
+
+    if (kind == NodeKind::bin_op) {
+        const std::optional<NodeIndex> operand = reduce_bin_op(node);
+        if (operand) {
+            return fold(*operand);
+        }
+    }
+
+    const NodeIndex index = m_folded.add(kind, position, m_ast.token(node));
+
+    switch (kind) {
+    case NodeKind::global_var:
+    case NodeKind::let_statement:
+    case NodeKind::var_statement:
+        m_folded.set(index, 0, m_ast.symbol(node, 0));
+        m_folded.set(index, 1, fold(m_ast.child(node, 1)));
+        break;
+    case NodeKind::function: {
+        const FlatList arguments = m_ast.list(node, 1);
+        m_folded.set(index, 0, m_ast.symbol(node, 0));
+        m_folded.set(index, 1, m_folded.add_list({
+            arguments.begin(),
+            arguments.end()
+        }));
+        m_folded.set(index, 2, fold_list(m_ast.list(node, 2)));
+        break;
+    }
+    case NodeKind::break_statement:
+    case NodeKind::continue_statement:
+        break;
+    case NodeKind::expression_statement:
+    case NodeKind::return_statement:
+    case NodeKind::un_op:
+        m_folded.set(index, 0, fold(m_ast.child(node, 0)));
+        break;
+    case NodeKind::for_statement:
+        m_folded.set(index, 0, m_ast.symbol(node, 0));
+        m_folded.set(index, 1, fold_list(m_ast.list(node, 1)));
+        m_folded.set(index, 2, fold_list(m_ast.list(node, 2)));
+        break;
+    case NodeKind::if_statement:
+        m_folded.set(index, 0, fold(m_ast.child(node, 0)));
+        m_folded.set(index, 1, fold_list(m_ast.list(node, 1)));
+        m_folded.set(index, 2, fold_list(m_ast.list(node, 2)));
+        break;
+    case NodeKind::while_statement:
+        m_folded.set(index, 0, fold(m_ast.child(node, 0)));
+        m_folded.set(index, 1, fold_list(m_ast.list(node, 1)));
+        break;
+    case NodeKind::address_of:
+    case NodeKind::variable:
+        m_folded.set(index, 0, m_ast.symbol(node, 0));
+        break;
+    case NodeKind::bin_op:
+        m_folded.set(index, 0, fold(m_ast.child(node, 0)));
+        m_folded.set(index, 1, fold(m_ast.child(node, 1)));
+        break;
+    case NodeKind::call:
+        m_folded.set(index, 0, m_ast.symbol(node, 0));
+        m_folded.set(index, 1, fold_list(m_ast.list(node, 1)));
+        break;
+    case NodeKind::numeral:
+        m_folded.set(index, 0, static_cast<std::uint32_t>(m_ast.value(node)));
+        break;
+    case NodeKind::string:
+        m_folded.set(index, 0, m_folded.add_string(m_ast.string(node, 0)));
+        break;
+    }
+
+    return index;
+}
+
+std::uint32_t ConstantFolder::fold_list(const FlatList& nodes) noexcept {
+    std::vector<std::uint32_t> indices {};
+    indices.reserve(nodes.size());
+    for (const NodeIndex node : nodes) {
+        indices.push_back(fold(node));
+    }
+    return m_folded.add_list(indices);
+}
+
+class Inliner {
+public:
+    explicit Inliner(
+            const FlatAst& ast,
+            FlatAst& inlined,
+            std::size_t budget) noexcept :
+        m_ast { ast },
+        m_inlined { inlined },
+        m_budget { budget },
+        m_globals(ast.symbols().size(), false),
+        m_functions(ast.symbols().size(), false),
+        m_addressed(ast.symbols().size(), false),
+        m_callees(ast.symbols().size()),
+        m_marks(ast.symbols().size(), false),
+        m_arguments(ast.symbols().size()) {
+    }
+
+    Inliner(const Inliner&) noexcept = delete;
+    Inliner& operator=(const Inliner&) noexcept = delete;
+
+    Inliner(Inliner&&) noexcept = default;
+    Inliner& operator=(Inliner&&) noexcept = delete;
+
+    ~Inliner() noexcept = default;
+
+    void inline_program() noexcept;
+
+private:
+    /* A function that may be inlined. */
+    struct Callee {
+        NodeIndex m_function;
+
+        /* Names of the local variables, without the parameters. */
+        std::vector<Symbol> m_locals;
+
+        /* Names assigned with "let". */
+        std::vector<Symbol> m_assigned;
+
+        /* Number of "return" statements. */
+        std::size_t m_returns;
+
+        /* Whether the last statement is a "return". */
+        bool m_tail_return;
+
+        /* Whether there are calls, which may change any variable. */
+        bool m_calls;
+    };
+
+    /* What the result of an inlined call is used for. */
+    enum class Use {
+        discard,    /* call statement */
+        assign,     /* value of "var" or "let" */
+        keep        /* value of "return" */
+    };
+
+    /* A call being inlined. */
+    struct Site {
+        NodeIndex m_call;
+        const Callee& m_callee;
+        Use m_use;
+
+        /* The variable assigned, if `m_use` is `Use::assign`. */
+        Symbol m_target;
+    };
+
+    const FlatAst& m_ast;
+    FlatAst& m_inlined;
+    std::size_t m_budget;
+
+    /* symbol -> whether it names a global variable or a function. */
+    std::vector<bool> m_globals;
+
+    /* symbol -> whether it names a function. */
+    std::vector<bool> m_functions;
+
+    /* symbol -> whether "&" takes its address anywhere in the program. */
+    std::vector<bool> m_addressed;
+
+    /* symbol -> the function it names, if that may be inlined. */
+    std::vector<std::optional<Callee>> m_callees;
+
+    /* symbol -> whether it is a name of the callee, see `conflicts`. */
+    std::vector<bool> m_marks;
+
+    /* symbol -> argument replacing the parameter, see `substitutes`. */
+    std::vector<std::optional<NodeIndex>> m_arguments;
+
+    /* The call whose callee is being copied, or nullptr. */
+    const Site* m_site { nullptr };
+
+    /** Find the functions that may be inlined. */
+    void find_callees() noexcept;
+
+    /**
+     * Check that a subtree of a function may be inlined and count its nodes
+     * in `size`. `loops` is the number of enclosing loops.
+     */
+    bool examine(
+            NodeIndex,
+            Callee&,
+            int loops,
+            std::size_t& size) const noexcept;
+
+    /** Whether the call of a site may be inlined, see `Site`. */
+    std::optional<Site> find_site(NodeIndex statement) const noexcept;
+
+    /**
+     * Whether the names of the callee would hide the target, or names in
+     * the arguments of a call, or a declared parameter would be hidden by a
+     * global of the same name.
+     */
+    bool conflicts(
+            const Callee&,
+            const FlatList& arguments,
+            Symbol target) noexcept;
+
+    /**
+     * Whether the callee may read an argument in place of a parameter,
+     * instead of declaring the parameter as a local variable.
+     */
+    bool substitutes(
+            const Callee&,
+            const FlatList& arguments,
+            std::size_t index) const noexcept;
+
+    /** Whether an expression refers to a marked name. */
+    bool refers_to_marks(NodeIndex) const noexcept;
+
+    /** Whether an expression calls a function. */
+    bool has_call(NodeIndex) const noexcept;
+
+    /** Append the copy of a subtree, return the index of its root. */
+    NodeIndex copy(NodeIndex) noexcept;
+
+    /** Copy statements and append the list of their roots. */
+    std::uint32_t copy_list(const FlatList&) noexcept;
+
+    /** Append the copy of a statement, or what it is replaced by, to `out`. */
+    void copy_statement(NodeIndex, std::vector<std::uint32_t>& out) noexcept;
+
+    /** Replace a statement with a call by the block of the callee. */
+    void inline_call(
+            NodeIndex statement,
+            const Site&,
+            std::vector<std::uint32_t>& out) noexcept;
+
+    /** Replace a "return" of the callee as the site needs it. */
+    void inline_return(
+            NodeIndex statement,
+            std::vector<std::uint32_t>& out) noexcept;
+
+    /** Append a numeral. */
+    NodeIndex numeral(int value, const Position&) noexcept;
+};
+
+FlatAst inline_functions(const FlatAst& ast, std::size_t budget) noexcept {
+    FlatAst inlined { ast.filename(), ast.symbols() };
+    Inliner inliner { ast, inlined, budget };
+    inliner.inline_program();
+    return inlined;
+}
+
+void Inliner::inline_program() noexcept {
+    find_callees();
+
+    for (const NodeIndex globalvar : m_ast.globalvars()) {
+        m_inlined.m_globalvars.push_back(copy(globalvar));
+    }
+
+    for (const NodeIndex function : m_ast.functions()) {
+        m_inlined.m_functions.push_back(copy(function));
+    }
+}
+
+void Inliner::find_callees() noexcept {
+    for (const NodeIndex globalvar : m_ast.globalvars()) {
+        m_globals[m_ast.symbol(globalvar, 0)] = true;
+    }
+
+    for (const NodeIndex function : m_ast.functions()) {
+        m_globals[m_ast.symbol(function, 0)] = true;
+        m_functions[m_ast.symbol(function, 0)] = true;
+    }
+
+    /* calls of a reassigned function may run other code */
+    std::vector<bool> reassigned(m_ast.symbols().size(), false);
+    for (NodeIndex node = 0; node < m_ast.size(); ++node) {
+        switch (m_ast.kind(node)) {
+        case NodeKind::let_statement:
+            reassigned[m_ast.symbol(node, 0)] = true;
+            break;
+        case NodeKind::address_of:
+            reassigned[m_ast.symbol(node, 0)] = true;
+            m_addressed[m_ast.symbol(node, 0)] = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    for (const NodeIndex function : m_ast.functions()) {
+        const Symbol name = m_ast.symbol(function, 0);
+        if (reassigned[name]) {
+            continue;
+        }
+
+        Callee callee { function, {}, {}, 0, false, false };
+        std::size_t size = 0;
+        const FlatList statements = m_ast.list(function, 2);
+        bool inlinable = true;
+        for (const NodeIndex statement : statements) {
+            inlinable = inlinable && examine(statement, callee, 0, size);
+        }
+
+        /* in the caller, globals win over locals of the same name */
+        for (const Symbol local : callee.m_locals) {
+            inlinable = inlinable && !m_globals[local];
+        }
+
+        if (!inlinable) {
+            continue;
+        }
+
+        callee.m_tail_return = statements.size() > 0 &&
+            m_ast.kind(statements[statements.size() - 1]) ==
+                NodeKind::return_statement;
+        m_callees[name] = std::move(callee);
+    }
+}
+
+bool Inliner::examine(
+        NodeIndex node,
+        Callee& callee,
+        int loops,
+        std::size_t& size) const noexcept {
+
+    size += 1;
+    if (size > m_budget) {
+        return false;
+    }
+
+    const auto all = [&](const FlatList& nodes, int depth) {
+        for (const NodeIndex child : nodes) {
+            if (!examine(child, callee, depth, size)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    switch (m_ast.kind(node)) {
+    case NodeKind::global_var:
+    case NodeKind::function:
+        return false;
+    case NodeKind::break_statement:
+    case NodeKind::continue_statement:
+    case NodeKind::numeral:
+    case NodeKind::string:
+    case NodeKind::variable:
+        return true;
+    case NodeKind::expression_statement:
+    case NodeKind::un_op:
+        return examine(m_ast.child(node, 0), callee, loops, size);
+    case NodeKind::return_statement:
+        /* "break" would leave the loop, not the inlined block */
+        callee.m_returns += 1;
+        return loops == 0 &&
+            examine(m_ast.child(node, 0), callee, loops, size);
+    case NodeKind::for_statement:
+        callee.m_locals.push_back(m_ast.symbol(node, 0));
+        return all(m_ast.list(node, 1), loops) &&
+            all(m_ast.list(node, 2), loops + 1);
+    case NodeKind::if_statement:
+        return examine(m_ast.child(node, 0), callee, loops, size) &&
+            all(m_ast.list(node, 1), loops) &&
+            all(m_ast.list(node, 2), loops);
+    case NodeKind::while_statement:
+        return examine(m_ast.child(node, 0), callee, loops, size) &&
+            all(m_ast.list(node, 1), loops + 1);
+    case NodeKind::var_statement:
+        callee.m_locals.push_back(m_ast.symbol(node, 0));
+        return examine(m_ast.child(node, 1), callee, loops, size);
+    case NodeKind::let_statement:
+        callee.m_assigned.push_back(m_ast.symbol(node, 0));
+        return examine(m_ast.child(node, 1), callee, loops, size);
+    case NodeKind::address_of: {
+        /* the address of a parameter may be used to reach the others */
+        const FlatList arguments = m_ast.list(callee.m_function, 1);
+        for (const Symbol argument : arguments) {
+            if (argument == m_ast.symbol(node, 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case NodeKind::bin_op:
+        return examine(m_ast.child(node, 0), callee, loops, size) &&
+            examine(m_ast.child(node, 1), callee, loops, size);
+    case NodeKind::call:
+        callee.m_calls = true;
+        return !m_functions[m_ast.symbol(node, 0)] &&
+            all(m_ast.list(node, 1), loops);
+    }
+
+    return false;
+}
+
+std::optional<Inliner::Site> Inliner::find_site(
+        NodeIndex statement) const noexcept {
+
+    Use use = Use::discard;
+    Symbol target = SymbolTable::no_symbol;
+    NodeIndex call = 0;
+
+    switch (m_ast.kind(statement)) {
+    case NodeKind::expression_statement:
+        call = m_ast.child(statement, 0);
+        break;
+    case NodeKind::let_statement:
+    case NodeKind::var_statement:
+        use = Use::assign;
+        target = m_ast.symbol(statement, 0);
+        call = m_ast.child(statement, 1);
+        break;
+    case NodeKind::return_statement:
+        use = Use::keep;
+        call = m_ast.child(statement, 0);
+        break;
+    default:
+        return std::nullopt;
+    }
+
+    if (m_ast.kind(call) != NodeKind::call) {
+        return std::nullopt;
+    }
+
+    const std::optional<Callee>& callee = m_callees[m_ast.symbol(call, 0)];
+    if (!callee) {
+        return std::nullopt;
+    }
+
+    const FlatList arguments = m_ast.list(call, 1);
+    if (arguments.size() != m_ast.list(callee->m_function, 1).size()) {
+        return std::nullopt;
+    }
+
+    return Site { call, *callee, use, target };
+}
+
+bool Inliner::conflicts(
+        const Callee& callee,
+        const FlatList& arguments,
+        Symbol target) noexcept {
+
+    /* an argument sees the parameters declared before it, not its own */
+    const FlatList parameters = m_ast.list(callee.m_function, 1);
+    bool result = false;
+    for (std::size_t i = arguments.size(); i > 0; --i) {
+        if (!substitutes(callee, arguments, i - 1)) {
+            result = result || refers_to_marks(arguments[i - 1]);
+            result = result || m_globals[parameters[i - 1]];
+            m_marks[parameters[i - 1]] = true;
+        }
+    }
+
+    /* substituted arguments see all names of the callee */
+    for (const Symbol name : callee.m_locals) {
+        m_marks[name] = true;
+    }
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (substitutes(callee, arguments, i)) {
+            result = result || refers_to_marks(arguments[i]);
+        }
+    }
+    result = result || (target != SymbolTable::no_symbol && m_marks[target]);
+
+    for (const Symbol name : parameters) {
+        m_marks[name] = false;
+    }
+    for (const Symbol name : callee.m_locals) {
+        m_marks[name] = false;
+    }
+
+    return result;
+}
+
+bool Inliner::substitutes(
+        const Callee& callee,
+        const FlatList& arguments,
+        std::size_t index) const noexcept {
+
+    const NodeIndex argument = arguments[index];
+    const Symbol parameter = m_ast.list(callee.m_function, 1)[index];
+    for (const Symbol name : callee.m_assigned) {
+        if (name == parameter) {
+            return false;
+        }
+    }
+
+    switch (m_ast.kind(argument)) {
+    case NodeKind::numeral:
+        return true;
+    case NodeKind::variable: {
+        /* only calls and "let" may change a local variable of the caller */
+        const Symbol name = m_ast.symbol(argument, 0);
+        if (m_globals[name] || callee.m_calls) {
+            return false;
+        }
+
+        /*
+         * The arguments before it are evaluated after it, and a call in
+         * them may change it through its address.
+         */
+        if (m_addressed[name]) {
+            for (std::size_t i = 0; i < index; ++i) {
+                if (has_call(arguments[i])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool Inliner::refers_to_marks(NodeIndex node) const noexcept {
+    switch (m_ast.kind(node)) {
+    case NodeKind::address_of:
+    case NodeKind::variable:
+        return m_marks[m_ast.symbol(node, 0)];
+    case NodeKind::bin_op:
+        return refers_to_marks(m_ast.child(node, 0)) ||
+            refers_to_marks(m_ast.child(node, 1));
+    case NodeKind::call:
+        for (const NodeIndex argument : m_ast.list(node, 1)) {
+            if (refers_to_marks(argument)) {
+                return true;
+            }
+        }
+        return false;
+    case NodeKind::un_op:
+        return refers_to_marks(m_ast.child(node, 0));
+    default:
+        return false;
+    }
+}
+
+bool Inliner::has_call(NodeIndex node) const noexcept {
+    switch (m_ast.kind(node)) {
+    case NodeKind::bin_op:
+        return has_call(m_ast.child(node, 0)) ||
+            has_call(m_ast.child(node, 1));
+    case NodeKind::call:
+        return true;
+    case NodeKind::un_op:
+        return has_call(m_ast.child(node, 0));
+    default:
+        return false;
+    }
+}
+
+NodeIndex Inliner::copy(NodeIndex node) noexcept {
+    if (m_ast.kind(node) == NodeKind::variable &&
+            m_arguments[m_ast.symbol(node, 0)]) {
+        /* a numeral or variable, both have one operand */
+        node = *m_arguments[m_ast.symbol(node, 0)];
+        const NodeIndex index = m_inlined.add(
+            m_ast.kind(node),
+            m_ast.position(node),
+            m_ast.token(node));
+        m_inlined.set(index, 0, m_ast.symbol(node, 0));
+        return index;
+    }
+
+    const NodeKind kind = m_ast.kind(node);
+    const NodeIndex index =
+        m_inlined.add(kind, m_ast.position(node), m_ast.token(node));
+
+    switch (kind) {
+    case NodeKind::global_var:
+    case NodeKind::let_statement:
+    case NodeKind::var_statement:
+        m_inlined.set(index, 0, m_ast.symbol(node, 0));
+        m_inlined.set(index, 1, copy(m_ast.child(node, 1)));
+        break;
+    case NodeKind::function: {
+        const FlatList arguments = m_ast.list(node, 1);
+        m_inlined.set(index, 0, m_ast.symbol(node, 0));
+        m_inlined.set(index, 1, m_inlined.add_list({
+            arguments.begin(),
+            arguments.end()
+        }));
+        m_inlined.set(index, 2, copy_list(m_ast.list(node, 2)));
+        break;
+    }
+    case NodeKind::break_statement:
+    case NodeKind::continue_statement:
+        break;
+    case NodeKind::expression_statement:
+    case NodeKind::return_statement:
+    case NodeKind::un_op:
+        m_inlined.set(index, 0, copy(m_ast.child(node, 0)));
+        break;
+    case NodeKind::for_statement:
+        m_inlined.set(index, 0, m_ast.symbol(node, 0));
+        m_inlined.set(index, 1, copy_list(m_ast.list(node, 1)));
+        m_inlined.set(index, 2, copy_list(m_ast.list(node, 2)));
+        break;
+    case NodeKind::if_statement:
+        m_inlined.set(index, 0, copy(m_ast.child(node, 0)));
+        m_inlined.set(index, 1, copy_list(m_ast.list(node, 1)));
+        m_inlined.set(index, 2, copy_list(m_ast.list(node, 2)));
+        break;
+    case NodeKind::while_statement:
+        m_inlined.set(index, 0, copy(m_ast.child(node, 0)));
+        m_inlined.set(index, 1, copy_list(m_ast.list(node, 1)));
+        break;
+    case NodeKind::address_of:
+    case NodeKind::variable:
+        m_inlined.set(index, 0, m_ast.symbol(node, 0));
+        break;
+    case NodeKind::bin_op:
+        m_inlined.set(index, 0, copy(m_ast.child(node, 0)));
+        m_inlined.set(index, 1, copy(m_ast.child(node, 1)));
+        break;
+    case NodeKind::call:
+        m_inlined.set(index, 0, m_ast.symbol(node, 0));
+        m_inlined.set(index, 1, copy_list(m_ast.list(node, 1)));
+        break;
+    case NodeKind::numeral:
+        m_inlined.set(index, 0, static_cast<std::uint32_t>(m_ast.value(node)));
+        break;
+    case NodeKind::string:
+        m_inlined.set(index, 0, m_inlined.add_string(m_ast.string(node, 0)));
+        break;
+    }
+
+    return index;
+}
+
+std::uint32_t Inliner::copy_list(const FlatList& nodes) noexcept {
+    std::vector<std::uint32_t> indices {};
+    indices.reserve(nodes.size());
+    for (const NodeIndex node : nodes) {
+        copy_statement(node, indices);
+    }
+    return m_inlined.add_list(indices);
+}
+
+void Inliner::copy_statement(
+        NodeIndex node,
+        std::vector<std::uint32_t>& out) noexcept {
+
+    if (m_site != nullptr && m_ast.kind(node) == NodeKind::return_statement) {
+        inline_return(node, out);
+        return;
+    }
+
+    const std::optional<Site> site = find_site(node);
+    if (!site) {
+        out.push_back(copy(node));
+        return;
+    }
+
+    const FlatList arguments = m_ast.list(site->m_call, 1);
+    if (conflicts(site->m_callee, arguments, site->m_target)) {
+        out.push_back(copy(node));
+        return;
+    }
+
+    inline_call(node, *site, out);
+}
+
+void Inliner::inline_call(
+        NodeIndex statement,
+        const Site& site,
+        std::vector<std::uint32_t>& out) noexcept {
+
+    const Position& position = m_ast.position(statement);
+    const Callee& callee = site.m_callee;
+
+    /* the result if the callee does not return one */
+    if (m_ast.kind(statement) == NodeKind::var_statement) {
+        const NodeIndex var = m_inlined.add(NodeKind::var_statement, position);
+        m_inlined.set(var, 0, site.m_target);
+        m_inlined.set(var, 1, numeral(0, position));
+        out.push_back(var);
+    }
+
+    /* "return" leaves the function anyway if the result is returned */
+    const std::size_t early_returns =
+        callee.m_returns - (callee.m_tail_return ? 1 : 0);
+    const bool loop = early_returns > 0 && site.m_use != Use::keep;
+
+    const NodeIndex block = m_inlined.add(
+        loop ? NodeKind::while_statement : NodeKind::if_statement,
+        position);
+    m_inlined.set(block, 0, numeral(1, position));
+
+    std::vector<std::uint32_t> statements {};
+
+    /* parameters, right to left as `visit_call` pushes them */
+    const FlatList parameters = m_ast.list(callee.m_function, 1);
+    const FlatList arguments = m_ast.list(site.m_call, 1);
+    for (std::size_t i = arguments.size(); i > 0; --i) {
+        if (substitutes(callee, arguments, i - 1)) {
+            continue;
+        }
+
+        const NodeIndex var = m_inlined.add(NodeKind::var_statement, position);
+        m_inlined.set(var, 0, parameters[i - 1]);
+        m_inlined.set(var, 1, copy(arguments[i - 1]));
+        statements.push_back(var);
+    }
+
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (substitutes(callee, arguments, i)) {
+            m_arguments[parameters[i]] = arguments[i];
+        }
+    }
+
+    m_site = &site;
+    for (const NodeIndex node : m_ast.list(callee.m_function, 2)) {
+        copy_statement(node, statements);
+    }
+    m_site = nullptr;
+
+    for (const Symbol parameter : parameters) {
+        m_arguments[parameter] = std::nullopt;
+    }
+
+    if (!callee.m_tail_return) {
+        if (site.m_use == Use::keep) {
+            const NodeIndex ret =
+                m_inlined.add(NodeKind::return_statement, position);
+            m_inlined.set(ret, 0, numeral(0, position));
+            statements.push_back(ret);
+        } else if (m_ast.kind(statement) == NodeKind::let_statement) {
+            const NodeIndex let =
+                m_inlined.add(NodeKind::let_statement, position);
+            m_inlined.set(let, 0, site.m_target);
+            m_inlined.set(let, 1, numeral(0, position));
+            statements.push_back(let);
+        }
+    }
+
+    if (loop) {
+        statements.push_back(
+            m_inlined.add(NodeKind::break_statement, position));
+    }
+
+    m_inlined.set(block, 1, m_inlined.add_list(statements));
+    if (!loop) {
+        m_inlined.set(block, 2, m_inlined.add_list({}));
+    }
+    out.push_back(block);
+}
+
+void Inliner::inline_return(
+        NodeIndex statement,
+        std::vector<std::uint32_t>& out) noexcept {
+
+    const Position& position = m_ast.position(statement);
+    const FlatList statements = m_ast.list(m_site->m_callee.m_function, 2);
+    const bool tail = statement == statements[statements.size() - 1];
+
+    NodeIndex result = 0;
+    switch (m_site->m_use) {
+    case Use::discard:
+        result = m_inlined.add(NodeKind::expression_statement, position);
+        m_inlined.set(result, 0, copy(m_ast.child(statement, 0)));
+        break;
+    case Use::assign:
+        result = m_inlined.add(NodeKind::let_statement, position);
+        m_inlined.set(result, 0, m_site->m_target);
+        m_inlined.set(result, 1, copy(m_ast.child(statement, 0)));
+        break;
+    case Use::keep:
+        out.push_back(copy(statement));
+        return;
+    }
+
+    out.push_back(result);
+    if (!tail) {
+        out.push_back(m_inlined.add(NodeKind::break_statement, position));
+    }
+}
+
+NodeIndex Inliner::numeral(int value, const Position& position) noexcept {
+    const NodeIndex index = m_inlined.add(NodeKind::numeral, position);
+    m_inlined.set(index, 0, static_cast<std::uint32_t>(value));
+    return index;
+}
+
+} /* namespace arabilis */
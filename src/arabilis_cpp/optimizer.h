@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+#include "flat_ast.h"
+
+#include <cstddef>
+
+namespace arabilis {
+
+/*
+ * Fold operators with constant operands into numerals, with the wrap-around
+ * and truncation of the generated code. Operators with a neutral constant
+ * operand are replaced by the other operand, e.g. "x + 0" and "x * 1".
+ * Operators with an absorbing constant operand are replaced by the result,
+ * e.g. "x * 0" and "x & 0", if the dropped operand has no calls and no
+ * division that might trap. Divisions that trap are kept as they are.
+ *
+ * Dropping operands may drop names, so the program must have passed
+ * `check_variable_usage` before. The result refers to the strings and
+ * symbols of `ast`.
+ */
+[[nodiscard]] FlatAst fold_constants(const FlatAst& ast) noexcept;
+
+/*
+ * Replace calls of small leaf functions by their statements, if the call is
+ * a statement of its own or the value of a "var", "let" or "return"
+ * statement. A function is inlined if its statements have at most `budget`
+ * nodes, it calls no other function, it is never assigned with "let" or
+ * "&", its "return"s are outside of loops, and its local variables and the
+ * parameters it declares do not share the name of a global variable or
+ * function, which would take precedence in the caller.
+ *
+ * The statements go into a nested block that first declares the parameters
+ * as local variables, evaluating the arguments right to left like a call.
+ * Parameters that are never assigned are replaced by numeral arguments, and
+ * by local variables of the caller if the function has no calls. A local
+ * variable whose address is taken is not used in place of a parameter if
+ * an argument before it calls a function, which may change it. A "return"
+ * sets the result and leaves the block with "break", so the block is a
+ * "while (1)" loop if the function returns early.
+ *
+ * The block declares the names of the function again, so the result does
+ * not pass `check_variable_usage`, the program must have passed it before.
+ * The result refers to the strings and symbols of `ast`.
+ */
+[[nodiscard]] FlatAst inline_functions(
+        const FlatAst& ast,
+        std::size_t budget = 16) noexcept;
+
+} /* namespace arabilis */
+
+#endif /* OPTIMIZER_H_ */
@@ -0,0 +1,409 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "peephole.h"
+
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+namespace arabilis {
+
+/*
+ * A register in a pattern. `r` and `s` stand for registers the expression
+ * code generator allocates, `any` matches every register.
+ */
+enum class Field : std::uint8_t {
+    r,
+    s,
+    any,
+    ebp
+};
+
+/*
+ * One instruction of a pattern. `m_x` binds the operand, i.e. an immediate
+ * or a label. A `gap` stands for any number of instructions that neither
+ * use the stack, nor jump, nor use the register bound to `r`.
+ */
+struct Element {
+    Opcode m_opcode;
+    Field m_r { Field::any };
+    Field m_s { Field::any };
+    bool m_x { false };
+};
+
+static constexpr Element gap { Opcode::label };
+
+/* Rewrite rules, in the order they are tried. */
+struct Pattern {
+    const char* m_name;
+    std::vector<Element> m_match;
+    std::vector<Element> m_replace;
+};
+
+static const Pattern patterns[] = {
+    {
+        "push-pop",
+        { { Opcode::push_reg, Field::r }, { Opcode::pop_reg, Field::r } },
+        {}
+    },
+    {
+        "push-pop-move",
+        { { Opcode::push_reg, Field::r }, { Opcode::pop_reg, Field::s } },
+        { { Opcode::mov_reg_reg, Field::s, Field::r } }
+    },
+    {
+        "push-imm-pop",
+        {
+            { Opcode::push_imm, Field::any, Field::any, true },
+            { Opcode::pop_reg, Field::r }
+        },
+        { { Opcode::mov_reg_imm, Field::r, Field::r, true } }
+    },
+    {
+        "unused-save",
+        { { Opcode::push_reg, Field::r }, gap, { Opcode::pop_reg, Field::r } },
+        { gap }
+    },
+    {
+        "load-local",
+        {
+            { Opcode::mov_reg_reg, Field::r, Field::ebp },
+            { Opcode::add_reg_imm, Field::r, Field::any, true },
+            { Opcode::mov_reg_ref_reg, Field::r, Field::r }
+        },
+        { { Opcode::mov_reg_ref_ebp_imm, Field::r, Field::r, true } }
+    }
+};
+
+/* Instructions pending in the window are kept at most this long. */
+static constexpr std::size_t window_size = 64;
+
+/* Values bound to the placeholders of a pattern. */
+struct Bindings {
+    std::optional<Register> m_r {};
+    std::optional<Register> m_s {};
+    std::optional<Instruction> m_x {};
+};
+
+/* Where a pattern matched the end of the window. */
+struct Match {
+    Bindings m_bindings {};
+    std::size_t m_begin { 0 };
+    std::size_t m_gap_begin { 0 };
+    std::size_t m_gap_end { 0 };
+};
+
+/* Registers the expression code generator allocates. */
+static bool is_allocatable(Register reg) noexcept {
+    return reg != Register::esp && reg != Register::ebp;
+}
+
+static bool bind(std::optional<Register>& slot, Register value) noexcept {
+    if (!slot.has_value()) {
+        slot = value;
+    }
+
+    return *slot == value;
+}
+
+static bool matches(
+        Field field,
+        Register reg,
+        Bindings& bindings) noexcept {
+
+    switch (field) {
+    case Field::r:
+        return is_allocatable(reg) && bind(bindings.m_r, reg);
+    case Field::s:
+        return is_allocatable(reg) && bind(bindings.m_s, reg);
+    case Field::any:
+        return true;
+    case Field::ebp:
+        return reg == Register::ebp;
+    }
+
+    return false;
+}
+
+static bool matches(
+        const Element& element,
+        const Instruction& instruction,
+        Bindings& bindings) noexcept {
+
+    if (element.m_opcode != instruction.m_opcode) {
+        return false;
+    }
+
+    if (element.m_x) {
+        const Instruction& x = bindings.m_x.value_or(instruction);
+        if (x.m_operand != instruction.m_operand ||
+                x.m_value != instruction.m_value) {
+            return false;
+        }
+        bindings.m_x = instruction;
+    }
+
+    return matches(element.m_r, instruction.m_r, bindings) &&
+        matches(element.m_s, instruction.m_s, bindings);
+}
+
+/* Whether a gap may skip over an instruction, see `Element`. */
+static bool is_transparent(
+        const Instruction& instruction,
+        Register reg) noexcept {
+
+    if (is_relative_branch(instruction.m_opcode)) {
+        return false;
+    }
+
+    switch (instruction.m_opcode) {
+    case Opcode::call_ref_reg:
+    case Opcode::cdq:
+    case Opcode::hop_ne:
+    case Opcode::idiv_reg:
+    case Opcode::idiv_ref_esp:
+    case Opcode::int_80:
+    case Opcode::jmp_reg:
+    case Opcode::pop_reg:
+    case Opcode::push_reg:
+    case Opcode::push_imm:
+    case Opcode::ret:
+        return false;
+    default:
+        break;
+    }
+
+    for (const Register used : { instruction.m_r, instruction.m_s }) {
+        if (used == reg || used == Register::esp) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+class Peephole {
+public:
+    explicit Peephole(std::vector<Instruction>& output) noexcept :
+            m_output { output },
+            m_counts(std::size(patterns), 0) {
+    }
+
+    Peephole(const Peephole&) noexcept = delete;
+    Peephole& operator=(const Peephole&) noexcept = delete;
+
+    Peephole(Peephole&&) noexcept = delete;
+    Peephole& operator=(Peephole&&) noexcept = delete;
+
+    ~Peephole() noexcept = default;
+
+    /* Take the next item of code. */
+    void write(const Instruction&) noexcept;
+
+    /* Write all pending instructions. */
+    void flush() noexcept;
+
+    [[nodiscard]] std::vector<PeepholeCount> counts() const noexcept;
+
+private:
+    std::vector<Instruction>& m_output;
+
+    /* Straight-line instructions not written yet. */
+    std::vector<Instruction> m_pending {};
+
+    /* Number of following items to write as they are. */
+    std::size_t m_fixed { 0 };
+
+    std::vector<std::size_t> m_counts;
+
+    /** Append an instruction to the window and rewrite its end. */
+    void push(const Instruction&) noexcept;
+
+    /** Match a pattern against the end of the window. */
+    bool match(const Pattern&, Match&) const noexcept;
+
+    /** Instructions a matched pattern is replaced with. */
+    std::vector<Instruction> replace(
+            const Pattern&,
+            const Match&) const noexcept;
+
+    /** Write the first `count` pending instructions. */
+    void write_pending(std::size_t count) noexcept;
+};
+
+std::vector<PeepholeCount> optimize_peephole(Code& code) noexcept {
+    std::vector<Instruction> output {};
+    output.reserve(code.items().size());
+
+    Peephole peephole { output };
+    for (const Instruction& item : code.items()) {
+        peephole.write(item);
+    }
+
+    peephole.flush();
+    code.items() = std::move(output);
+    return peephole.counts();
+}
+
+void Peephole::write(const Instruction& item) noexcept {
+    /* labels, data, text, and the code "hop_ne" hops over */
+    if (m_fixed > 0 || !is_instruction(item.m_opcode)) {
+        flush();
+        m_output.push_back(item);
+        m_fixed -= (m_fixed > 0) ? 1 : 0;
+        return;
+    }
+
+    if (item.m_opcode == Opcode::hop_ne) {
+        flush();
+        m_output.push_back(item);
+        m_fixed = 2;
+        return;
+    }
+
+    push(item);
+}
+
+void Peephole::flush() noexcept {
+    write_pending(m_pending.size());
+}
+
+std::vector<PeepholeCount> Peephole::counts() const noexcept {
+    std::vector<PeepholeCount> counts {};
+    for (std::size_t i = 0; i < m_counts.size(); ++i) {
+        counts.push_back({ patterns[i].m_name, m_counts[i] });
+    }
+    return counts;
+}
+
+void Peephole::push(const Instruction& instruction) noexcept {
+    m_pending.push_back(instruction);
+
+    for (std::size_t i = 0; i < std::size(patterns); ++i) {
+        Match match {};
+        if (!this->match(patterns[i], match)) {
+            continue;
+        }
+
+        m_counts[i] += 1;
+        const std::vector<Instruction> replacement =
+            replace(patterns[i], match);
+        m_pending.erase(m_pending.begin() + match.m_begin, m_pending.end());
+
+        /* replacements may complete other patterns */
+        for (const Instruction& new_instruction : replacement) {
+            push(new_instruction);
+        }
+        return;
+    }
+
+    if (m_pending.size() > window_size) {
+        write_pending(m_pending.size() - window_size / 2);
+    }
+}
+
+bool Peephole::match(const Pattern& pattern, Match& match) const noexcept {
+    /* right to left, so `r` is bound when reaching a gap */
+    std::size_t position = m_pending.size();
+
+    for (std::size_t i = pattern.m_match.size(); i-- > 0;) {
+        if (pattern.m_match[i].m_opcode == gap.m_opcode) {
+            match.m_gap_end = position;
+            while (position > 0) {
+                Bindings bindings = match.m_bindings;
+                if (matches(
+                        pattern.m_match[i - 1],
+                        m_pending[position - 1],
+                        bindings)) {
+                    break;
+                }
+
+                if (!is_transparent(
+                        m_pending[position - 1],
+                        *match.m_bindings.m_r)) {
+                    return false;
+                }
+
+                position -= 1;
+            }
+            match.m_gap_begin = position;
+            continue;
+        }
+
+        if (position == 0 || !matches(
+                pattern.m_match[i],
+                m_pending[position - 1],
+                match.m_bindings)) {
+            return false;
+        }
+
+        position -= 1;
+    }
+
+    match.m_begin = position;
+    return true;
+}
+
+/* Register bound to a field of a replacement. */
+static Register bound(Field field, const Bindings& bindings) noexcept {
+    switch (field) {
+    case Field::r:
+        return *bindings.m_r;
+    case Field::s:
+        return *bindings.m_s;
+    case Field::ebp:
+        return Register::ebp;
+    case Field::any:
+        break;
+    }
+
+    return Register::eax;
+}
+
+std::vector<Instruction> Peephole::replace(
+        const Pattern& pattern,
+        const Match& match) const noexcept {
+
+    const Bindings& bindings = match.m_bindings;
+
+    std::vector<Instruction> replacement {};
+    for (const Element& element : pattern.m_replace) {
+        if (element.m_opcode == gap.m_opcode) {
+            replacement.insert(
+                replacement.end(),
+                m_pending.begin() + match.m_gap_begin,
+                m_pending.begin() + match.m_gap_end);
+            continue;
+        }
+
+        Instruction instruction {
+            element.m_opcode,
+            bound(element.m_r, bindings),
+            bound(element.m_s, bindings),
+            Operand::none,
+            0,
+            0
+        };
+
+        if (element.m_x) {
+            instruction.m_operand = bindings.m_x->m_operand;
+            instruction.m_value = bindings.m_x->m_value;
+        }
+
+        replacement.push_back(instruction);
+    }
+
+    return replacement;
+}
+
+void Peephole::write_pending(std::size_t count) noexcept {
+    m_output.insert(
+        m_output.end(),
+        m_pending.begin(),
+        m_pending.begin() + count);
+    m_pending.erase(m_pending.begin(), m_pending.begin() + count);
+}
+
+} /* namespace arabilis */
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef PEEPHOLE_H_
+#define PEEPHOLE_H_
+
+#include "ir.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace arabilis {
+
+/* Number of rewrites of one peephole pattern. */
+struct PeepholeCount {
+    const char* m_name;
+    std::size_t m_count;
+};
+
+/*
+ * Rewrite redundant instruction sequences in `code`, e.g. "push_eax"
+ * directly followed by "pop_ebx". Only straight-line code is rewritten:
+ * labels, data and text end a sequence, and the instructions a "hop_ne"
+ * hops over are kept as they are. The replacements use the macros defined
+ * with `CompileOptions::m_registers`.
+ *
+ * Returns the number of rewrites of each pattern, in the order of the
+ * pattern table.
+ */
+[[nodiscard]] std::vector<PeepholeCount> optimize_peephole(Code&) noexcept;
+
+} /* namespace arabilis */
+
+#endif /* PEEPHOLE_H_ */
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "scan.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ARABILIS_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace arabilis {
+
+static constexpr bool is_whitespace(unsigned char c) {
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
+
+static constexpr bool is_numeral(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+static constexpr bool is_id_trail(unsigned char c) {
+    return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || is_numeral(c) ||
+        c == '_';
+}
+
+template <bool (*predicate)(unsigned char)>
+static const char* scan_scalar(const char* begin, const char* end) noexcept {
+    while (begin != end && predicate(static_cast<unsigned char>(*begin))) {
+        begin += 1;
+    }
+
+    return begin;
+}
+
+#ifdef ARABILIS_SCAN_X86
+
+/*
+ * Each vector kernel classifies a block of bytes at once and stops at the
+ * first byte outside the class. The remainder shorter than one block is
+ * left to the scalar loop.
+ */
+
+__attribute__((target("sse2")))
+static inline __m128i in_range_sse2(__m128i v, char low, char high) noexcept {
+    /* rotate, so that `low` becomes -128, and compare signed */
+    const __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(-128 - low));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + (high - low + 1)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i whitespace_sse2(__m128i v) noexcept {
+    return _mm_or_si128(
+        _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i id_trail_sse2(__m128i v) noexcept {
+    const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_or_si128(
+        _mm_or_si128(
+            in_range_sse2(lower, 'a', 'z'),
+            in_range_sse2(v, '0', '9')),
+        _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i numeral_sse2(__m128i v) noexcept {
+    return in_range_sse2(v, '0', '9');
+}
+
+template <
+    __m128i (*classify)(__m128i),
+    bool (*predicate)(unsigned char)>
+__attribute__((target("sse2")))
+static const char* scan_sse2(const char* begin, const char* end) noexcept {
+    while (end - begin >= 16) {
+        const __m128i v = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(begin));
+        const unsigned mask = _mm_movemask_epi8(classify(v)) ^ 0xffffu;
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 16;
+    }
+
+    return scan_scalar<predicate>(begin, end);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i in_range_avx2(__m256i v, char low, char high) noexcept {
+    /* rotate, so that `low` becomes -128, and compare signed */
+    const __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(-128 - low));
+    return _mm256_cmpgt_epi8(
+        _mm256_set1_epi8(-128 + (high - low + 1)),
+        shifted);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i whitespace_avx2(__m256i v) noexcept {
+    return _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i id_trail_avx2(__m256i v) noexcept {
+    const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(
+        _mm256_or_si256(
+            in_range_avx2(lower, 'a', 'z'),
+            in_range_avx2(v, '0', '9')),
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i numeral_avx2(__m256i v) noexcept {
+    return in_range_avx2(v, '0', '9');
+}
+
+template <
+    __m256i (*classify)(__m256i),
+    bool (*predicate)(unsigned char)>
+__attribute__((target("avx2")))
+static const char* scan_avx2(const char* begin, const char* end) noexcept {
+    while (end - begin >= 32) {
+        const __m256i v = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(begin));
+        const unsigned mask = ~static_cast<unsigned>(
+            _mm256_movemask_epi8(classify(v)));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 32;
+    }
+
+    return scan_scalar<predicate>(begin, end);
+}
+
+#endif /* ARABILIS_SCAN_X86 */
+
+using Kernel = const char* (*)(const char*, const char*) noexcept;
+
+struct Kernels {
+    Kernel m_whitespace;
+    Kernel m_id_trail;
+    Kernel m_numeral;
+};
+
+static Kernels select_kernels() noexcept {
+#ifdef ARABILIS_SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return {
+            scan_avx2<whitespace_avx2, is_whitespace>,
+            scan_avx2<id_trail_avx2, is_id_trail>,
+            scan_avx2<numeral_avx2, is_numeral>
+        };
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return {
+            scan_sse2<whitespace_sse2, is_whitespace>,
+            scan_sse2<id_trail_sse2, is_id_trail>,
+            scan_sse2<numeral_sse2, is_numeral>
+        };
+    }
+#endif /* ARABILIS_SCAN_X86 */
+
+    return {
+        scan_scalar<is_whitespace>,
+        scan_scalar<is_id_trail>,
+        scan_scalar<is_numeral>
+    };
+}
+
+static const Kernels kernels = select_kernels();
+
+const char* scan_whitespace(const char* begin, const char* end) noexcept {
+    return kernels.m_whitespace(begin, end);
+}
+
+const char* scan_line(const char* begin, const char* end) noexcept {
+    /* the C library ships a vectorized search for single bytes already */
+    const void* newline = std::memchr(begin, '\n', end - begin);
+    if (newline == nullptr) {
+        return end;
+    }
+
+    return static_cast<const char*>(newline);
+}
+
+const char* scan_id_trail(const char* begin, const char* end) noexcept {
+    return kernels.m_id_trail(begin, end);
+}
+
+const char* scan_numeral(const char* begin, const char* end) noexcept {
+    return kernels.m_numeral(begin, end);
+}
+
+} /* namespace arabilis */
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef SCAN_H_
+#define SCAN_H_
+
+namespace arabilis {
+
+/*
+ * Scanning kernels for the lexer. Each returns the end of the run of
+ * matching bytes starting at `begin`, or `end` if the run reaches it.
+ * The implementation is chosen at startup, depending on the instruction
+ * set extensions the CPU supports.
+ */
+
+/* Run of ' ', '\t', '\r' and '\n'. */
+const char* scan_whitespace(const char* begin, const char* end) noexcept;
+
+/* Run of anything but '\n'. */
+const char* scan_line(const char* begin, const char* end) noexcept;
+
+/* Run of 'a'-'z', 'A'-'Z', '0'-'9' and '_'. */
+const char* scan_id_trail(const char* begin, const char* end) noexcept;
+
+/* Run of '0'-'9'. */
+const char* scan_numeral(const char* begin, const char* end) noexcept;
+
+} /* namespace arabilis */
+
+#endif /* SCAN_H_ */
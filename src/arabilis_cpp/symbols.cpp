@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#include "symbols.h"
+
+namespace arabilis {
+
+Symbol SymbolTable::intern(std::string_view name) noexcept {
+    const auto symbol = static_cast<Symbol>(m_names.size());
+    const auto inserted = m_symbols.emplace(name, symbol);
+
+    if (inserted.second) {
+        m_names.push_back(name);
+    }
+
+    return inserted.first->second;
+}
+
+Symbol SymbolTable::find(std::string_view name) const noexcept {
+    const auto it = m_symbols.find(name);
+    return it == m_symbols.end() ? no_symbol : it->second;
+}
+
+} /* namespace arabilis */
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2020 Tim Wiederhake
+
+#ifndef SYMBOLS_H_
+#define SYMBOLS_H_
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace arabilis {
+
+/* Dense id of a distinct name, in order of first appearance. */
+using Symbol = std::uint32_t;
+
+/*
+ * Maps each distinct identifier to a `Symbol` once, when it is lexed, so
+ * that later passes compare and index by integer. Names refer to the input
+ * buffer, which must outlive the table.
+ */
+class SymbolTable {
+public:
+    static constexpr Symbol no_symbol = UINT32_MAX;
+
+    explicit SymbolTable() noexcept = default;
+
+    SymbolTable(const SymbolTable&) noexcept = delete;
+    SymbolTable& operator=(const SymbolTable&) noexcept = delete;
+
+    SymbolTable(SymbolTable&&) noexcept = default;
+    SymbolTable& operator=(SymbolTable&&) noexcept = default;
+
+    ~SymbolTable() noexcept = default;
+
+    /* Symbol for `name`, added if new. */
+    Symbol intern(std::string_view name) noexcept;
+
+    /* Symbol for `name`, or `no_symbol` if it never appeared. */
+    [[nodiscard]] Symbol find(std::string_view name) const noexcept;
+
+    [[nodiscard]] std::string_view name(Symbol symbol) const noexcept {
+        return m_names[symbol];
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return m_names.size();
+    }
+
+private:
+    std::unordered_map<std::string_view, Symbol> m_symbols {};
+    std::vector<std::string_view> m_names {};
+};
+
+/*
+ * Value per symbol, in nested scopes. Setting a value records the previous
+ * one in an undo log, and leaving a scope restores the values set since it
+ * was entered. Entering and leaving thus cost time in the number of symbols
+ * declared in the scope, not in the number of symbols overall.
+ */
+template<typename T>
+class ScopedSymbols {
+public:
+    explicit ScopedSymbols(std::size_t size) noexcept : m_values(size) {
+    }
+
+    ScopedSymbols(const ScopedSymbols&) noexcept = delete;
+    ScopedSymbols& operator=(const ScopedSymbols&) noexcept = delete;
+
+    ScopedSymbols(ScopedSymbols&&) noexcept = default;
+    ScopedSymbols& operator=(ScopedSymbols&&) noexcept = default;
+
+    ~ScopedSymbols() noexcept = default;
+
+    [[nodiscard]] typename std::vector<T>::const_reference operator[](
+            Symbol symbol) const noexcept {
+        return m_values[symbol];
+    }
+
+    void set(Symbol symbol, T value) noexcept {
+        m_undo.emplace_back(symbol, std::move(m_values[symbol]));
+        m_values[symbol] = std::move(value);
+    }
+
+    /* Open a scope, return the marker to pass to `leave`. */
+    [[nodiscard]] std::size_t enter() const noexcept {
+        return m_undo.size();
+    }
+
+    /* Close all scopes opened since `enter` returned `scope`. */
+    void leave(std::size_t scope) noexcept {
+        while (m_undo.size() > scope) {
+            auto& undo = m_undo.back();
+            m_values[undo.first] = std::move(undo.second);
+            m_undo.pop_back();
+        }
+    }
+
+private:
+    std::vector<T> m_values;
+    std::vector<std::pair<Symbol, T>> m_undo {};
+};
+
+} /* namespace arabilis */
+
+#endif /* SYMBOLS_H_ */
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+# Copyright 2020 Tim Wiederhake
+
+import argparse
+import os
+import subprocess
+import time
+
+
+FAIL = "\033[1;31m FAIL \033[1;m"
+PASS = "\033[1;32m PASS \033[1;m"
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument(
+        "program",
+        help="Path to test program.",
+        type=os.path.realpath)
+
+    parser.add_argument(
+        "--globals",
+        help="Number of global variables.",
+        type=int,
+        default=10000)
+
+    parser.add_argument(
+        "--depth",
+        help="Nesting depth of blocks.",
+        type=int,
+        default=1000)
+
+    parser.add_argument(
+        "--timeout",
+        help="Time limit in seconds.",
+        type=float,
+        default=10.0)
+
+    return parser.parse_args()
+
+
+def generate(globals_count, depth):
+    lines = ["var g%d = %d;" % (i, i) for i in range(globals_count)]
+
+    lines.append("function main() {")
+    lines.append("var sum = 0;")
+
+    # Rotate through the block statements, each declaring a local variable
+    # and referring to a global one.
+    for level in range(depth):
+        kind = level % 3
+        if kind == 0:
+            lines.append("if (sum < %d) {" % level)
+        elif kind == 1:
+            lines.append("while (sum < %d) {" % level)
+        else:
+            lines.append("for (var i%d = 0; i%d < 1; let i%d = i%d + 1) {" % (
+                level, level, level, level))
+        lines.append("var v%d = g%d;" % (level, level % globals_count))
+        lines.append("let sum = sum + v%d;" % level)
+
+    for level in reversed(range(depth)):
+        if level % 3 == 1:
+            lines.append("break;")
+        lines.append("}")
+
+    lines.append("return sum;")
+    lines.append("}")
+
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    args = parse_args()
+    source = generate(args.globals, args.depth)
+
+    begin = time.monotonic()
+    try:
+        p = subprocess.run(
+            [args.program],
+            input=str.encode(source),
+            stdout=subprocess.DEVNULL,
+            stderr=subprocess.PIPE,
+            timeout=args.timeout)
+        failure = p.returncode != 0 and "returncode %d: %s" % (
+            p.returncode,
+            p.stderr.decode(errors="replace").strip())
+    except subprocess.TimeoutExpired:
+        failure = "timed out after %.1f s" % args.timeout
+    elapsed = time.monotonic() - begin
+
+    print("[%s] %s %d globals, depth %d (%.2f s)" % (
+        FAIL if failure else PASS,
+        os.path.basename(args.program),
+        args.globals,
+        args.depth,
+        elapsed))
+
+    if failure:
+        print("\t%s" % failure)
+
+    exit(1 if failure else 0)
+
+
+if __name__ == "__main__":
+    main()